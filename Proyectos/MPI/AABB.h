@@ -0,0 +1,50 @@
+#pragma once
+
+#include <algorithm>
+#include <limits>
+
+#include "Vec3.h"
+#include "Ray.h"
+
+// Caja alineada con los ejes. Vacia por defecto (min = +inf, max = -inf).
+struct AABB {
+	Vec3 min;
+	Vec3 max;
+
+	AABB() : min(std::numeric_limits<float>::max(), std::numeric_limits<float>::max(), std::numeric_limits<float>::max()),
+		max(-std::numeric_limits<float>::max(), -std::numeric_limits<float>::max(), -std::numeric_limits<float>::max()) {}
+	AABB(const Vec3& min, const Vec3& max) : min(min), max(max) {}
+
+	void grow(const Vec3& p) {
+		min = Vec3(std::min(min.x(), p.x()), std::min(min.y(), p.y()), std::min(min.z(), p.z()));
+		max = Vec3(std::max(max.x(), p.x()), std::max(max.y(), p.y()), std::max(max.z(), p.z()));
+	}
+	void grow(const AABB& b) {
+		grow(b.min);
+		grow(b.max);
+	}
+
+	bool empty() const { return min.x() > max.x(); }
+	Vec3 centroid() const { return 0.5f * (min + max); }
+	Vec3 extent() const { return max - min; }
+
+	float surfaceArea() const {
+		if (empty()) return 0.0f;
+		Vec3 e = extent();
+		return 2.0f * (e.x() * e.y() + e.y() * e.z() + e.z() * e.x());
+	}
+
+	// Test de slabs. invDir = 1 / direccion del rayo; en tEntry deja la distancia de entrada.
+	bool hit(const Vec3& origin, const Vec3& invDir, float t_min, float t_max, float& tEntry) const {
+		for (int a = 0; a < 3; a++) {
+			float t0 = (min[a] - origin[a]) * invDir[a];
+			float t1 = (max[a] - origin[a]) * invDir[a];
+			if (invDir[a] < 0.0f) std::swap(t0, t1);
+			t_min = t0 > t_min ? t0 : t_min;
+			t_max = t1 < t_max ? t1 : t_max;
+			if (t_max < t_min) return false;
+		}
+		tEntry = t_min;
+		return true;
+	}
+};
@@ -0,0 +1,26 @@
+#include "Accelerator.h"
+
+#include "BVH.h"
+#include "LBVH.h"
+#include "SphereSIMD.h"
+#include "UniformGrid.h"
+#include "WideBVH.h"
+
+Accelerator* createAccelerator(const std::string& name) {
+	if (name == "bvh") return new BVH();
+	if (name == "lbvh") return new LBVH();
+	if (name == "bvh4") return new WideBVH<4>();
+	if (name == "bvh8") return new WideBVH<8>();
+	if (name == "grid") return new UniformGrid();
+	if (name == "simd") return new SphereSIMD();
+	return nullptr;
+}
+
+Accelerator* chooseAccelerator(const std::string& name, const std::vector<Object*>& ol) {
+	if (name != "auto") return createAccelerator(name);
+	if (int(ol.size()) > SIMD_MAX_SPHERES) return new BVH();
+	for (Object* o : ol) {
+		if (o->getShape()->type() != SHAPE_SPHERE) return new BVH();
+	}
+	return new SphereSIMD();
+}
@@ -0,0 +1,429 @@
+#include "BVH.h"
+
+#include <numeric>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <immintrin.h>
+#define BVH_SSE
+#endif
+
+static const int SAH_BINS = 16;
+static const int MAX_LEAF_SIZE = 8;
+static const double REFIT_MAX_GROWTH = 1.5;
+
+void BVH::build(const std::vector<Object*>& ol) {
+	nodes.clear();
+	objects.clear();
+	finish();
+	if (ol.empty()) return;
+
+	std::vector<BuildPrim> prims(ol.size());
+	for (size_t i = 0; i < ol.size(); i++) {
+		prims[i].bounds = ol[i]->boundingBox();
+		prims[i].centroid = prims[i].bounds.centroid();
+		prims[i].object = ol[i];
+		prims[i].index = int(i);
+	}
+
+	nodes.reserve(2 * ol.size());
+	nodes.emplace_back();
+	subdivide(0, prims, 0, int(prims.size()));
+
+	objects.resize(prims.size());
+	slotOf.resize(prims.size());
+	for (size_t i = 0; i < prims.size(); i++) {
+		objects[i] = prims[i].object;
+		slotOf[prims[i].index] = int(i);
+	}
+	finish();
+}
+
+bool BVH::attach(const BVHNode* data, int count, const std::vector<Object*>& leafObjects) {
+	nodes.clear();
+	objects = leafObjects;
+	packSpheres(objects, spheres);
+	slotOf.resize(objects.size());
+	std::iota(slotOf.begin(), slotOf.end(), 0);	// la escena se carga en el orden de las hojas
+	nodeData = data;
+	numNodes = count;
+	parent.clear();
+	stackSize = measureStack();
+	if (stackSize < 0) {
+		nodeData = nullptr;
+		numNodes = 0;
+		return false;
+	}
+	return true;
+}
+
+int BVH::measureStack() const {
+	if (numNodes == 0) return 0;
+
+	// en profundidad primero quedan apilados como mucho un hermano por nivel y los dos hijos
+	// del ultimo nodo abierto: profundidad + 1 entradas
+	int maxDepth = 0;
+	int visited = 0;
+	std::vector<std::pair<int, int> > pending(1, std::make_pair(0, 0));
+	while (!pending.empty()) {
+		int i = pending.back().first;
+		int depth = pending.back().second;
+		pending.pop_back();
+		if (++visited > numNodes) return -1;
+		maxDepth = std::max(maxDepth, depth);
+		const BVHNode& node = nodeData[i];
+		if (node.isLeaf()) {
+			if (node.leftFirst < 0 || node.leftFirst > int(objects.size()) - node.count) return -1;
+			continue;
+		}
+		if (node.leftFirst < 1 || node.leftFirst >= numNodes - 1) return -1;
+		pending.push_back(std::make_pair(node.leftFirst, depth + 1));
+		pending.push_back(std::make_pair(node.leftFirst + 1, depth + 1));
+	}
+	return maxDepth + 1;
+}
+
+// Coste SAH sin normalizar: area por numero de objetos en las hojas, area en los internos
+float BVH::nodeCost(const BVHNode& node) const {
+	return node.bounds.surfaceArea() * (node.isLeaf() ? float(node.count) : 1.0f);
+}
+
+bool BVH::prepareRefit() {
+	if (slotOf.size() != objects.size()) return false;
+
+	// los nodos proyectados desde la cache son de solo lectura: se copian
+	if (nodes.empty()) nodes.assign(nodeData, nodeData + numNodes);
+	rebind();
+
+	parent.assign(numNodes, -1);
+	level.assign(numNodes, 0);
+	leafOf.assign(objects.size(), -1);
+	dirty.assign(numNodes, 0);
+	sahSum = 0.0;
+	std::vector<int> pending(1, 0);
+	while (!pending.empty()) {
+		int i = pending.back();
+		pending.pop_back();
+		const BVHNode& node = nodes[i];
+		sahSum += nodeCost(node);
+		if (node.isLeaf()) {
+			for (int k = node.leftFirst; k < node.leftFirst + node.count; k++) leafOf[k] = i;
+			continue;
+		}
+		for (int c = node.leftFirst; c <= node.leftFirst + 1; c++) {
+			parent[c] = i;
+			level[c] = level[i] + 1;
+			pending.push_back(c);
+		}
+	}
+	float rootArea = nodes[0].bounds.surfaceArea();
+	buildCost = rootArea > 0.0f ? sahSum / rootArea : 0.0;
+	return true;
+}
+
+bool BVH::refit(const std::vector<Object*>& ol, const std::vector<int>& moved) {
+	if (numNodes == 0) return false;
+	if (parent.empty() && !prepareRefit()) return false;
+
+	// hojas de los objetos movidos y sus antecesores, cada nodo una vez
+	std::vector<int> touched;
+	for (int i : moved) {
+		int slot = slotOf[i];
+		objects[slot] = ol[i];
+		spheres[slot] = packSphere(ol[i]);
+		for (int n = leafOf[slot]; n >= 0 && !dirty[n]; n = parent[n]) {
+			dirty[n] = 1;
+			touched.push_back(n);
+		}
+	}
+
+	// de mas a menos profundo: cada nodo se recalcula despues que sus hijos
+	std::sort(touched.begin(), touched.end(), [&](int a, int b) { return level[a] > level[b]; });
+	for (int n : touched) {
+		BVHNode& node = nodes[n];
+		sahSum -= nodeCost(node);
+		AABB b;
+		if (node.isLeaf()) {
+			for (int k = node.leftFirst; k < node.leftFirst + node.count; k++) b.grow(objects[k]->boundingBox());
+		}
+		else {
+			b = nodes[node.leftFirst].bounds;
+			b.grow(nodes[node.leftFirst + 1].bounds);
+		}
+		node.bounds = b;
+		sahSum += nodeCost(node);
+		dirty[n] = 0;
+	}
+
+	float rootArea = nodes[0].bounds.surfaceArea();
+	return rootArea <= 0.0f || sahSum / rootArea <= REFIT_MAX_GROWTH * buildCost;
+}
+
+void BVH::subdivide(int nodeIdx, std::vector<BuildPrim>& prims, int first, int count) {
+	AABB bounds, centroidBounds;
+	for (int i = first; i < first + count; i++) {
+		bounds.grow(prims[i].bounds);
+		centroidBounds.grow(prims[i].centroid);
+	}
+	nodes[nodeIdx].bounds = bounds;
+	nodes[nodeIdx].leftFirst = first;
+	nodes[nodeIdx].count = count;
+	if (count <= 2) return;
+
+	// mejor corte: coste SAH = nL * area(L) + nR * area(R) entre las cubetas de cada eje
+	int bestAxis = -1, bestSplit = 0;
+	float bestCost = std::numeric_limits<float>::max();
+	Vec3 ext = centroidBounds.extent();
+	for (int axis = 0; axis < 3; axis++) {
+		if (ext[axis] <= 0.0f) continue;
+		float scale = SAH_BINS / ext[axis];
+
+		AABB binBounds[SAH_BINS];
+		int binCount[SAH_BINS] = {};
+		for (int i = first; i < first + count; i++) {
+			int b = std::min(SAH_BINS - 1, int((prims[i].centroid[axis] - centroidBounds.min[axis]) * scale));
+			binBounds[b].grow(prims[i].bounds);
+			binCount[b]++;
+		}
+
+		float leftArea[SAH_BINS - 1];
+		int leftCount[SAH_BINS - 1];
+		AABB acc;
+		int n = 0;
+		for (int b = 0; b < SAH_BINS - 1; b++) {
+			acc.grow(binBounds[b]);
+			n += binCount[b];
+			leftArea[b] = acc.surfaceArea();
+			leftCount[b] = n;
+		}
+		acc = AABB();
+		n = 0;
+		for (int b = SAH_BINS - 1; b > 0; b--) {
+			acc.grow(binBounds[b]);
+			n += binCount[b];
+			float cost = leftCount[b - 1] * leftArea[b - 1] + n * acc.surfaceArea();
+			if (leftCount[b - 1] > 0 && n > 0 && cost < bestCost) {
+				bestCost = cost;
+				bestAxis = axis;
+				bestSplit = b;
+			}
+		}
+	}
+
+	float leafCost = count * bounds.surfaceArea();
+	if (count <= MAX_LEAF_SIZE && (bestAxis == -1 || bestCost >= leafCost)) return;
+
+	int mid;
+	if (bestAxis == -1) {
+		// todos los centroides coinciden: reparto por la mitad
+		mid = first + count / 2;
+	}
+	else {
+		float scale = SAH_BINS / ext[bestAxis];
+		float minC = centroidBounds.min[bestAxis];
+		BuildPrim* split = std::partition(prims.data() + first, prims.data() + first + count, [&](const BuildPrim& p) {
+			return std::min(SAH_BINS - 1, int((p.centroid[bestAxis] - minC) * scale)) < bestSplit;
+		});
+		mid = int(split - prims.data());
+	}
+
+	int left = int(nodes.size());
+	nodes.emplace_back();
+	nodes.emplace_back();
+	nodes[nodeIdx].leftFirst = left;
+	nodes[nodeIdx].count = 0;
+	subdivide(left, prims, first, mid - first);
+	subdivide(left + 1, prims, mid, first + count - mid);
+}
+
+template <bool COUNT>
+Object* BVH::traverse(const Ray& r, float t_min, float t_max, float& closest, NodeCache* cache) const {
+	if (numNodes == 0) return nullptr;
+
+	Vec3 origin = r.origin();
+	Vec3 dir = r.direction();
+	Vec3 invDir(1.0f / dir.x(), 1.0f / dir.y(), 1.0f / dir.z());
+
+	Object* hit = nullptr;
+	closest = t_max;
+	float tEntry;
+
+	int local[STACK_SIZE];
+	std::vector<int> heap;
+	int* stack = local;
+	if (stackSize > STACK_SIZE) {
+		heap.resize(stackSize);
+		stack = heap.data();
+	}
+	int sp = 0;
+	if (COUNT) cache->touch(&nodeData[0]);
+	if (!nodeData[0].bounds.hit(origin, invDir, t_min, closest, tEntry)) return nullptr;
+	stack[sp++] = 0;
+
+	while (sp > 0) {
+		const BVHNode& node = nodeData[stack[--sp]];
+		if (node.isLeaf()) {
+			for (int i = node.leftFirst; COUNT && i < node.leftFirst + node.count; i++) {
+				cache->touch(&spheres[i]);
+				if (spheres[i].r2 < 0.0f) {
+					cache->touch(&objects[i]);
+					cache->touch(objects[i]);
+				}
+			}
+			int i = hitPackedRun(&spheres[node.leftFirst], &objects[node.leftFirst], node.count, r, t_min, closest);
+			if (i >= 0) hit = objects[node.leftFirst + i];
+			continue;
+		}
+
+		// primero el hijo mas cercano: se apila el lejano debajo
+		if (COUNT) {
+			cache->touch(&nodeData[node.leftFirst]);
+			cache->touch(&nodeData[node.leftFirst + 1]);
+		}
+		float tl, tr;
+		bool hl = nodeData[node.leftFirst].bounds.hit(origin, invDir, t_min, closest, tl);
+		bool hr = nodeData[node.leftFirst + 1].bounds.hit(origin, invDir, t_min, closest, tr);
+		if (hl && hr) {
+			if (tl <= tr) {
+				stack[sp++] = node.leftFirst + 1;
+				stack[sp++] = node.leftFirst;
+			}
+			else {
+				stack[sp++] = node.leftFirst;
+				stack[sp++] = node.leftFirst + 1;
+			}
+		}
+		else if (hl) stack[sp++] = node.leftFirst;
+		else if (hr) stack[sp++] = node.leftFirst + 1;
+	}
+	return hit;
+}
+
+Object* BVH::intersect(const Ray& r, float t_min, float t_max, float& t) const {
+	return traverse<false>(r, t_min, t_max, t, nullptr);
+}
+
+Object* BVH::intersectCounted(const Ray& r, float t_min, float t_max, float& t, NodeCache& cache) const {
+	return traverse<true>(r, t_min, t_max, t, &cache);
+}
+
+// Rayos del paquete en SoA, en grupos de 4 (los huecos del ultimo grupo con tmax < 0)
+struct PacketRays {
+	float ox[Accelerator::MAX_PACKET], oy[Accelerator::MAX_PACKET], oz[Accelerator::MAX_PACKET];
+	float dx[Accelerator::MAX_PACKET], dy[Accelerator::MAX_PACKET], dz[Accelerator::MAX_PACKET];
+	float ix[Accelerator::MAX_PACKET], iy[Accelerator::MAX_PACKET], iz[Accelerator::MAX_PACKET];
+	float tmax[Accelerator::MAX_PACKET];
+};
+
+// Mascara de los rayos [4g, 4g + 4) que cortan la caja en (t_min, tmax)
+static inline int hitBox4(const AABB& b, const PacketRays& p, int g, float t_min) {
+	int base = 4 * g;
+#ifdef BVH_SSE
+	__m128 tn = _mm_set1_ps(t_min);
+	__m128 tf = _mm_loadu_ps(p.tmax + base);
+	const float* o[3] = { p.ox + base, p.oy + base, p.oz + base };
+	const float* inv[3] = { p.ix + base, p.iy + base, p.iz + base };
+	for (int a = 0; a < 3; a++) {
+		__m128 oa = _mm_loadu_ps(o[a]);
+		__m128 ia = _mm_loadu_ps(inv[a]);
+		__m128 t0 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(b.min[a]), oa), ia);
+		__m128 t1 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(b.max[a]), oa), ia);
+		tn = _mm_max_ps(tn, _mm_min_ps(t0, t1));
+		tf = _mm_min_ps(tf, _mm_max_ps(t0, t1));
+	}
+	return _mm_movemask_ps(_mm_cmple_ps(tn, tf));
+#else
+	int mask = 0;
+	for (int k = 0; k < 4; k++) {
+		float tEntry;
+		Vec3 origin(p.ox[base + k], p.oy[base + k], p.oz[base + k]);
+		Vec3 invDir(p.ix[base + k], p.iy[base + k], p.iz[base + k]);
+		if (p.tmax[base + k] >= t_min && b.hit(origin, invDir, t_min, p.tmax[base + k], tEntry)) mask |= 1 << k;
+	}
+	return mask;
+#endif
+}
+
+void BVH::intersectPacket(const Ray* rays, int n, float t_min, float t_max, Object** hits, float* t) const {
+	PacketRays p;
+	int groups = (n + 3) / 4;
+	for (int k = 0; k < 4 * groups; k++) {
+		Vec3 o = k < n ? rays[k].origin() : Vec3(0, 0, 0);
+		Vec3 d = k < n ? rays[k].direction() : Vec3(1, 1, 1);
+		p.ox[k] = o.x(); p.oy[k] = o.y(); p.oz[k] = o.z();
+		p.dx[k] = d.x(); p.dy[k] = d.y(); p.dz[k] = d.z();
+		p.ix[k] = 1.0f / d.x(); p.iy[k] = 1.0f / d.y(); p.iz[k] = 1.0f / d.z();
+		p.tmax[k] = k < n ? t_max : -1.0f;
+		if (k < n) {
+			hits[k] = nullptr;
+			t[k] = t_max;
+		}
+	}
+	if (numNodes == 0) return;
+
+	// cada entrada: nodo y primer grupo de 4 rayos que puede cortarlo (los anteriores
+	// no cortan al padre y por tanto tampoco a el)
+	struct Entry {
+		int node;
+		int group;
+	};
+	Entry local[STACK_SIZE];
+	std::vector<Entry> heap;
+	Entry* stack = local;
+	if (stackSize > STACK_SIZE) {
+		heap.resize(stackSize);
+		stack = heap.data();
+	}
+	int sp = 0;
+	stack[sp++] = { 0, 0 };
+
+	while (sp > 0) {
+		sp--;
+		const BVHNode& node = nodeData[stack[sp].node];
+		int g = stack[sp].group;
+		int mask = 0;
+		while (g < groups && !(mask = hitBox4(node.bounds, p, g, t_min))) g++;
+		if (g == groups) continue;
+
+		// en la hoja cada esfera se prueba con los 4 rayos del grupo a la vez
+		if (node.isLeaf()) {
+			for (; g < groups; g++) {
+				if (!mask) mask = hitBox4(node.bounds, p, g, t_min);
+				if (!mask) continue;
+				int base = 4 * g;
+				Vec3x4 o(Floatx4::load(p.ox + base), Floatx4::load(p.oy + base), Floatx4::load(p.oz + base));
+				Vec3x4 d(Floatx4::load(p.dx + base), Floatx4::load(p.dy + base), Floatx4::load(p.dz + base));
+				for (int i = node.leftFirst; i < node.leftFirst + node.count; i++) {
+					int m = 0;
+					Floatx4 tHit(0.0f);
+					if (spheres[i].r2 >= 0.0f) {
+						m = hitPackedN(spheres[i], o, d, t_min, Floatx4::load(p.tmax + base), tHit) & mask;
+					}
+					else {
+						for (int k = 0; k < 4; k++) {
+							if ((mask >> k) & 1 && objects[i]->hitDistance(rays[base + k], t_min, p.tmax[base + k], tHit[k])) m |= 1 << k;
+						}
+					}
+					for (int k = 0; m; k++, m >>= 1) {
+						if (!(m & 1)) continue;
+						hits[base + k] = objects[i];
+						t[base + k] = p.tmax[base + k] = tHit[k];
+					}
+				}
+				mask = 0;
+			}
+			continue;
+		}
+
+		// orden de visita comun al paquete segun la direccion del primer rayo activo
+		int first = 4 * g;
+		while (!(mask & 1)) {
+			mask >>= 1;
+			first++;
+		}
+		const AABB& l = nodeData[node.leftFirst].bounds;
+		const AABB& r = nodeData[node.leftFirst + 1].bounds;
+		bool leftFirst = dot(l.centroid() - r.centroid(), rays[first].direction()) <= 0.0f;
+		stack[sp++] = { leftFirst ? node.leftFirst + 1 : node.leftFirst, g };
+		stack[sp++] = { leftFirst ? node.leftFirst : node.leftFirst + 1, g };
+	}
+}
@@ -1,18 +1,37 @@
 #pragma once
 
 #include "Vec3.h"
+#include "Vec3x.h"
 #include "Material.h"
 
 class Diffuse : public Material {
 public:
 	Diffuse(const Vec3& color) : color(color) {}
 
-	bool scatter(const Ray& ray, const CollisionData& cd, Vec3& attenuation, Ray& scattered) const {
-		Vec3 target = cd.p + cd.normal + randomNormalSphere();
+	bool scatter(const Ray& ray, const CollisionData& cd, Vec3& attenuation, Ray& scattered, Sampler* sampler) const {
+		// normal + vector unitario aleatorio: direccion con distribucion coseno (Lambert)
+		float u1, u2;
+		sampler->get2D(u1, u2);
+		Vec3 target = cd.p + cd.normal + sampleUnitVector(u1, u2);
 		scattered = Ray(cd.p, target - cd.p);
 		attenuation = color;
 		return true;
 	}
+
+	// Trazado por tandas (ScatterLanes.h): samples saca del sampler del camino las uniformes de
+	// scatter y scatterLanes hace sus cuentas para N choques a la vez
+	static void samples(Sampler* sampler, float* u) { sampler->get2D(u[0], u[1]); }
+	template <int N>
+	static void scatterLanes(const Vec3xN<N>& p, const Vec3xN<N>& normal, const float (*u)[3], Vec3xN<N>& direction) {
+		Vec3xN<N> unit;
+		for (int k = 0; k < N; k++) unit.set(k, sampleUnitVector(u[k][0], u[k][1]));
+		Vec3xN<N> target = p + normal + unit;
+		direction = target - p;
+	}
+
+	int type() const { return MATERIAL_DIFFUSE; }
+	void params(float* p) const { p[0] = color.x(); p[1] = color.y(); p[2] = color.z(); p[3] = 0.0f; }
+
 private:
 	Vec3 color;
 };
@@ -0,0 +1,226 @@
+#include "LBVH.h"
+
+#include <omp.h>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+static int countLeadingZeros(uint32_t v) {
+	if (v == 0) return 32;
+#ifdef _MSC_VER
+	unsigned long idx;
+	_BitScanReverse(&idx, v);
+	return 31 - int(idx);
+#else
+	return __builtin_clz(v);
+#endif
+}
+
+// intercala dos ceros entre cada uno de los 10 bits bajos de v
+static uint32_t expandBits(uint32_t v) {
+	v = (v * 0x00010001u) & 0xFF0000FFu;
+	v = (v * 0x00000101u) & 0x0F00F00Fu;
+	v = (v * 0x00000011u) & 0xC30C30C3u;
+	v = (v * 0x00000005u) & 0x49249249u;
+	return v;
+}
+
+uint32_t morton3D(const Vec3& p) {
+	uint32_t x = uint32_t(std::min(std::max(p.x() * 1024.0f, 0.0f), 1023.0f));
+	uint32_t y = uint32_t(std::min(std::max(p.y() * 1024.0f, 0.0f), 1023.0f));
+	uint32_t z = uint32_t(std::min(std::max(p.z() * 1024.0f, 0.0f), 1023.0f));
+	return expandBits(x) * 4 + expandBits(y) * 2 + expandBits(z);
+}
+
+// Radix LSD de 8 bits por pasada. Cada hilo cuenta y reparte sus propios bloques, asi que
+// el orden dentro de cada digito se mantiene (ordenacion estable).
+static void radixSort(std::vector<uint32_t>& keys, std::vector<int>& values) {
+	int n = int(keys.size());
+	int blocks = omp_get_max_threads();
+	std::vector<uint32_t> keysTmp(n);
+	std::vector<int> valuesTmp(n);
+	std::vector<int> hist(blocks * 256);
+
+	for (int shift = 0; shift < 32; shift += 8) {
+		#pragma omp parallel
+		{
+			int tid = omp_get_thread_num();
+			int nt = omp_get_num_threads();
+
+			for (int b = tid; b < blocks; b += nt) {
+				int* h = &hist[b * 256];
+				std::fill(h, h + 256, 0);
+				int end = int((long long)n * (b + 1) / blocks);
+				for (int i = int((long long)n * b / blocks); i < end; i++) {
+					h[(keys[i] >> shift) & 0xFF]++;
+				}
+			}
+			#pragma omp barrier
+
+			// posicion de salida de cada (digito, bloque)
+			#pragma omp single
+			{
+				int sum = 0;
+				for (int d = 0; d < 256; d++) {
+					for (int b = 0; b < blocks; b++) {
+						int c = hist[b * 256 + d];
+						hist[b * 256 + d] = sum;
+						sum += c;
+					}
+				}
+			}
+
+			for (int b = tid; b < blocks; b += nt) {
+				int* h = &hist[b * 256];
+				int end = int((long long)n * (b + 1) / blocks);
+				for (int i = int((long long)n * b / blocks); i < end; i++) {
+					int pos = h[(keys[i] >> shift) & 0xFF]++;
+					keysTmp[pos] = keys[i];
+					valuesTmp[pos] = values[i];
+				}
+			}
+		}
+		keys.swap(keysTmp);
+		values.swap(valuesTmp);
+	}
+}
+
+// Longitud del prefijo comun de las claves i y j; con codigos repetidos desempata el indice
+int LBVH::delta(const std::vector<uint32_t>& codes, int i, int j) const {
+	if (j < 0 || j >= int(codes.size())) return -1;
+	if (codes[i] == codes[j]) return 32 + countLeadingZeros(uint32_t(i ^ j));
+	return countLeadingZeros(codes[i] ^ codes[j]);
+}
+
+AABB LBVH::fitBounds(int nodeIdx) {
+	BVHNode& node = nodes[nodeIdx];
+	if (node.isLeaf()) return node.bounds;
+	AABB b = fitBounds(node.leftFirst);
+	b.grow(fitBounds(node.leftFirst + 1));
+	node.bounds = b;
+	return b;
+}
+
+void LBVH::build(const std::vector<Object*>& ol) {
+	nodes.clear();
+	objects.clear();
+	finish();
+	int n = int(ol.size());
+	if (n == 0) return;
+
+	// cajas de los objetos y caja de sus centros
+	std::vector<AABB> boxes(n);
+	std::vector<AABB> partial(omp_get_max_threads());
+	#pragma omp parallel
+	{
+		AABB local;
+		#pragma omp for
+		for (int i = 0; i < n; i++) {
+			boxes[i] = ol[i]->boundingBox();
+			local.grow(boxes[i].centroid());
+		}
+		partial[omp_get_thread_num()] = local;
+	}
+	AABB centroidBounds;
+	for (const AABB& b : partial) centroidBounds.grow(b);
+
+	Vec3 ext = centroidBounds.extent();
+	Vec3 scale(ext.x() > 0.0f ? 1.0f / ext.x() : 0.0f, ext.y() > 0.0f ? 1.0f / ext.y() : 0.0f, ext.z() > 0.0f ? 1.0f / ext.z() : 0.0f);
+
+	std::vector<uint32_t> codes(n);
+	std::vector<int> order(n);
+	#pragma omp parallel for
+	for (int i = 0; i < n; i++) {
+		codes[i] = morton3D((boxes[i].centroid() - centroidBounds.min) * scale);
+		order[i] = i;
+	}
+	radixSort(codes, order);
+
+	// Hoja k = objeto k en orden Morton. Los hijos del nodo interno i van juntos en
+	// nodes[2i + 1] y nodes[2i + 2]; la raiz (nodo interno 0) en nodes[0].
+	objects.resize(n);
+	slotOf.resize(n);
+	nodes.resize(2 * n - 1);
+	#pragma omp parallel for
+	for (int k = 0; k < n; k++) {
+		objects[k] = ol[order[k]];
+		slotOf[order[k]] = k;
+	}
+	if (n == 1) {
+		nodes[0].bounds = boxes[0];
+		nodes[0].leftFirst = 0;
+		nodes[0].count = 1;
+		finish();
+		return;
+	}
+	nodes[0].leftFirst = 1;
+	nodes[0].count = 0;
+
+	#pragma omp parallel for
+	for (int i = 0; i < n - 1; i++) {
+		// direccion del rango del nodo y su otro extremo j
+		int d = (delta(codes, i, i + 1) - delta(codes, i, i - 1)) >= 0 ? 1 : -1;
+		int deltaMin = delta(codes, i, i - d);
+		int lmax = 2;
+		while (delta(codes, i, i + lmax * d) > deltaMin) lmax *= 2;
+		int l = 0;
+		for (int t = lmax / 2; t >= 1; t /= 2) {
+			if (delta(codes, i, i + (l + t) * d) > deltaMin) l += t;
+		}
+		int j = i + l * d;
+
+		// punto de corte: ultimo indice que comparte con i mas bits que j
+		int deltaNode = delta(codes, i, j);
+		int s = 0;
+		for (int div = 2; ; div *= 2) {
+			int t = (l + div - 1) / div;
+			if (delta(codes, i, i + (s + t) * d) > deltaNode) s += t;
+			if (t == 1) break;
+		}
+		int gamma = i + s * d + std::min(d, 0);
+
+		int childIdx[2] = { gamma, gamma + 1 };
+		bool childLeaf[2] = { std::min(i, j) == gamma, std::max(i, j) == gamma + 1 };
+		for (int c = 0; c < 2; c++) {
+			BVHNode& child = nodes[2 * i + 1 + c];
+			if (childLeaf[c]) {
+				child.bounds = boxes[order[childIdx[c]]];
+				child.leftFirst = childIdx[c];
+				child.count = 1;
+			}
+			else {
+				child.leftFirst = 2 * childIdx[c] + 1;
+				child.count = 0;
+			}
+		}
+	}
+
+	// Cajas de abajo arriba: se baja por anchura hasta tener varios subarboles por hilo,
+	// cada uno se ajusta en paralelo y los nodos de encima se cierran en orden inverso
+	std::vector<int> top, frontier(1, 0);
+	while (int(frontier.size()) < 4 * omp_get_max_threads()) {
+		std::vector<int> next;
+		for (int idx : frontier) {
+			if (nodes[idx].isLeaf()) {
+				next.push_back(idx);
+				continue;
+			}
+			top.push_back(idx);
+			next.push_back(nodes[idx].leftFirst);
+			next.push_back(nodes[idx].leftFirst + 1);
+		}
+		if (next.size() == frontier.size()) break;
+		frontier.swap(next);
+	}
+	#pragma omp parallel for schedule(dynamic, 1)
+	for (int k = 0; k < int(frontier.size()); k++) {
+		fitBounds(frontier[k]);
+	}
+	for (int k = int(top.size()) - 1; k >= 0; k--) {
+		BVHNode& node = nodes[top[k]];
+		node.bounds = nodes[node.leftFirst].bounds;
+		node.bounds.grow(nodes[node.leftFirst + 1].bounds);
+	}
+	finish();
+}
@@ -1,8 +1,10 @@
 #include "Metallic.h"
 
-bool Metallic::scatter(const Ray& r_in, const CollisionData& cd, Vec3& attenuation, Ray& scattered) const {
+bool Metallic::scatter(const Ray& r_in, const CollisionData& cd, Vec3& attenuation, Ray& scattered, Sampler* sampler) const {
 	Vec3 reflected = reflect(unit_vector(r_in.direction()), cd.normal);
-	scattered = Ray(cd.p, reflected + fuzz * randomNormalSphere());
+	float u1, u2;
+	sampler->get2D(u1, u2);
+	scattered = Ray(cd.p, reflected + fuzz * sampleInSphere(u1, u2, sampler->get1D()));
 	attenuation = albedo;
 	return (dot(scattered.direction(), cd.normal) > 0);
 }
@@ -1,7 +1,8 @@
 #pragma once
 
 #include "utils.h"
-#include "random.h"
+#include "Sampler.h"
+#include "Vec3x.h"
 
 #include "Material.h"
 
@@ -9,7 +10,22 @@ class Metallic : public Material {
 public:
 	Metallic(const Vec3& a, float f) : albedo(a) { if (f < 1) fuzz = f; else fuzz = 1; }
 
-	bool scatter(const Ray& r_in, const CollisionData& cd, Vec3& attenuation, Ray& scattered) const;
+	bool scatter(const Ray& r_in, const CollisionData& cd, Vec3& attenuation, Ray& scattered, Sampler* sampler) const;
+
+	// Trazado por tandas (ScatterLanes.h): uniformes de scatter y sus cuentas para N choques a la
+	// vez, con el fuzz de cada uno. Devuelve la mascara de los que rebotan.
+	static void samples(Sampler* sampler, float* u) { sampler->get2D(u[0], u[1]); u[2] = sampler->get1D(); }
+	template <int N>
+	static int scatterLanes(const Vec3xN<N>& dir, const Vec3xN<N>& normal, const FloatxN<N>& fuzz, const float (*u)[3], Vec3xN<N>& direction) {
+		Vec3xN<N> reflected = reflect(unit_vector(dir), normal);
+		Vec3xN<N> offset;
+		for (int k = 0; k < N; k++) offset.set(k, sampleInSphere(u[k][0], u[k][1], u[k][2]));
+		direction = reflected + fuzz * offset;
+		return dot(direction, normal) > FloatxN<N>(0.0f);
+	}
+
+	int type() const { return MATERIAL_METALLIC; }
+	void params(float* p) const { p[0] = albedo.x(); p[1] = albedo.y(); p[2] = albedo.z(); p[3] = fuzz; }
 
 private:
 	Vec3 albedo;
@@ -0,0 +1,142 @@
+#pragma once
+
+#include <vector>
+
+#include "Object.h"
+#include "Sphere.h"
+#include "Vec3x.h"
+
+// Copia compacta de una esfera para los bucles de interseccion: 16 bytes, 4 por linea de
+// cache. Va en un vector paralelo a una lista de objetos que se recorre seguido, en vez de
+// saltar por el heap de Object a Shape en cada prueba. r2 < 0 marca otra forma, que se prueba
+// a traves de su objeto.
+struct PackedSphere {
+	float cx, cy, cz, r2;
+};
+
+inline PackedSphere packSphere(const Object* o) {
+	PackedSphere p = { 0.0f, 0.0f, 0.0f, -1.0f };
+	if (o->getShape()->type() != SHAPE_SPHERE) return p;
+	const Sphere* s = static_cast<const Sphere*>(o->getShape());
+	Vec3 c = s->getCenter();
+	p.cx = c.x();
+	p.cy = c.y();
+	p.cz = c.z();
+	p.r2 = s->getRadius() * s->getRadius();
+	return p;
+}
+
+inline void packSpheres(const std::vector<Object*>& ol, std::vector<PackedSphere>& packed) {
+	packed.resize(ol.size());
+	for (size_t i = 0; i < ol.size(); i++) packed[i] = packSphere(ol[i]);
+}
+
+// Como o->hitDistance; solo se lee o si no es una esfera
+inline bool hitPacked(const PackedSphere& s, const Object* o, const Ray& r, float t_min, float t_max, float& t) {
+	if (s.r2 < 0.0f) return o->hitDistance(r, t_min, t_max, t);
+	return sphereHitDistance(Vec3(s.cx, s.cy, s.cz), s.r2, r, t_min, t_max, t);
+}
+
+// Operaciones de sphereHitDistance en N carriles, con oc = origen - centro ya restado y los
+// radios al cuadrado en r2. Solo cuentan los carriles de lanes. Devuelve la mascara de los que
+// cortan en (t_min, t_max[k]), con su distancia en t; los demas carriles de t no cambian.
+// Raices en double como en sphereHitDistance, y solo en los carriles que cortan.
+template <int N>
+inline int hitSphereLanes(const Vec3xN<N>& oc, const Vec3xN<N>& d, const FloatxN<N>& r2, int lanes, float t_min, const FloatxN<N>& t_max, FloatxN<N>& t) {
+	FloatxN<N> a = dot(d, d);
+	FloatxN<N> b = dot(oc, d);
+	FloatxN<N> c = dot(oc, oc) - r2;
+	FloatxN<N> discriminant = b * b - a * c;
+	int valid = (discriminant > FloatxN<N>(0.0f)) & lanes;
+	if (!valid) return 0;
+	FloatxN<N> t1(0.0f), t2(0.0f);
+	for (int m = valid, k = 0; m; k++, m >>= 1) {
+		if (!(m & 1)) continue;
+		double root = sqrt(double(discriminant[k]));
+		t1[k] = float((-b[k] - root) / a[k]);
+		t2[k] = float((-b[k] + root) / a[k]);
+	}
+	FloatxN<N> tn(t_min);
+	int first = valid & (t1 < t_max) & (t1 > tn);
+	int second = valid & ~first & (t2 < t_max) & (t2 > tn);
+	t = select(first, t1, select(second, t2, t));
+	return first | second;
+}
+
+// sphereHitDistance de la esfera s con N rayos a la vez (origenes o, direcciones d), cada uno
+// en (t_min, t_max[k]). Devuelve la mascara de los rayos que la cortan, con su distancia en t;
+// los demas carriles de t no cambian.
+template <int N>
+inline int hitPackedN(const PackedSphere& s, const Vec3xN<N>& o, const Vec3xN<N>& d, float t_min, const FloatxN<N>& t_max, FloatxN<N>& t) {
+	return hitSphereLanes(o - Vec3xN<N>(Vec3(s.cx, s.cy, s.cz)), d, FloatxN<N>(s.r2), (1 << N) - 1, t_min, t_max, t);
+}
+
+// Tiras mas cortas que esta (hojas de una o dos esferas) van una a una con hitPacked: cargar y
+// transponer el grupo cuesta mas que las pruebas que se ahorran.
+static const int PACKED_RUN_MIN = 3;
+
+// Choque mas cercano de r con la tira de count esferas empaquetadas s, paralela a los objetos
+// objs (una hoja o una lista entera), en (t_min, closest). Las esferas van de 4 en 4 en SoA:
+// primero el discriminante de las 4 y, si alguna corta, hitSphereLanes; las otras formas del
+// grupo van una a una por su objeto. Da lo mismo que probarlas una a una acortando closest: el
+// grupo se prueba hasta el closest de antes del grupo y gana el mas cercano y, a igual
+// distancia, el primero. Devuelve el indice en la tira (o -1) y deja su distancia en closest.
+inline int hitPackedRun(const PackedSphere* s, Object* const* objs, int count, const Ray& r, float t_min, float& closest) {
+	int hit = -1;
+	if (count < PACKED_RUN_MIN) {
+		for (int i = 0; i < count; i++) {
+			if (hitPacked(s[i], objs[i], r, t_min, closest, closest)) hit = i;
+		}
+		return hit;
+	}
+	Vec3x4 o(r.origin()), d(r.direction());
+#ifdef VEC3X_SSE
+	__m128 ox = _mm_set1_ps(r.origin().x()), oy = _mm_set1_ps(r.origin().y()), oz = _mm_set1_ps(r.origin().z());
+	__m128 dx = _mm_set1_ps(r.direction().x()), dy = _mm_set1_ps(r.direction().y()), dz = _mm_set1_ps(r.direction().z());
+	__m128 a = _mm_set1_ps(dot(r.direction(), r.direction()));
+#endif
+	for (int g = 0; g < count; g += 4) {
+		int n = count - g < 4 ? count - g : 4;
+		int range = (1 << n) - 1;
+		Vec3x4 c;
+		Floatx4 r2;
+#ifdef VEC3X_SSE
+		// cuatro esferas son una transposicion de cuatro registros; las que faltan, con r2 = 0
+		__m128 x = _mm_loadu_ps(&s[g].cx);
+		__m128 y = n > 1 ? _mm_loadu_ps(&s[g + 1].cx) : _mm_setzero_ps();
+		__m128 z = n > 2 ? _mm_loadu_ps(&s[g + 2].cx) : _mm_setzero_ps();
+		__m128 w = n > 3 ? _mm_loadu_ps(&s[g + 3].cx) : _mm_setzero_ps();
+		_MM_TRANSPOSE4_PS(x, y, z, w);
+		int others = _mm_movemask_ps(_mm_cmplt_ps(w, _mm_setzero_ps())) & range;
+		// mismas operaciones que hitSphereLanes, para saltarse el grupo si no corta ninguna
+		__m128 ocx = _mm_sub_ps(ox, x), ocy = _mm_sub_ps(oy, y), ocz = _mm_sub_ps(oz, z);
+		__m128 b = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ocx, dx), _mm_mul_ps(ocy, dy)), _mm_mul_ps(ocz, dz));
+		__m128 cc = _mm_sub_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(ocx, ocx), _mm_mul_ps(ocy, ocy)), _mm_mul_ps(ocz, ocz)), w);
+		int valid = _mm_movemask_ps(_mm_cmpgt_ps(_mm_sub_ps(_mm_mul_ps(b, b), _mm_mul_ps(a, cc)), _mm_setzero_ps())) & range & ~others;
+		if (!valid && !others) continue;
+		_mm_storeu_ps(c.x.v, x);
+		_mm_storeu_ps(c.y.v, y);
+		_mm_storeu_ps(c.z.v, z);
+		_mm_storeu_ps(r2.v, w);
+#else
+		for (int k = 0; k < 4; k++) {
+			PackedSphere p = k < n ? s[g + k] : PackedSphere{ 0.0f, 0.0f, 0.0f, 0.0f };
+			c.set(k, Vec3(p.cx, p.cy, p.cz));
+			r2[k] = p.r2;
+		}
+		int others = (r2 < Floatx4(0.0f)) & range;
+#endif
+		Floatx4 t(0.0f);
+		int mask = hitSphereLanes(o - c, d, r2, range & ~others, t_min, Floatx4(closest), t);
+		for (int k = 0; others; k++, others >>= 1) {
+			if ((others & 1) && objs[g + k]->hitDistance(r, t_min, closest, t[k])) mask |= 1 << k;
+		}
+		for (int k = 0; mask; k++, mask >>= 1) {
+			if ((mask & 1) && t[k] < closest) {
+				closest = t[k];
+				hit = g + k;
+			}
+		}
+	}
+	return hit;
+}
@@ -0,0 +1,18 @@
+#include "Plane.h"
+
+bool Plane::hitDistance(const Ray& ray, float t_min, float t_max, float& t) const {
+	float denom = dot(normal, ray.direction());
+	if (denom == 0.0f) return false;
+	float temp = (offset - dot(normal, ray.origin())) / denom;
+	if (temp < t_max && temp > t_min) {
+		t = temp;
+		return true;
+	}
+	return false;
+}
+
+void Plane::hitAttributes(const Ray& ray, float t, CollisionData& cd) const {
+	cd.time = t;
+	cd.p = ray.point_at_parameter(t);
+	cd.normal = normal;
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include "Shape.h"
+
+// Plano infinito dot(normal, p) = offset; la normal (unitaria) da la cara visible.
+// No tiene caja: la escena lo prueba siempre, fuera de la estructura de aceleracion.
+class Plane : public Shape {
+public:
+	Plane(): normal(0, 1, 0), offset() {}
+	Plane(Vec3 normal, float offset) : normal(unit_vector(normal)), offset(offset) {}
+
+	bool hitDistance(const Ray& ray, float t_min, float t_max, float& t) const;
+	void hitAttributes(const Ray& ray, float t, CollisionData& cd) const;
+	AABB boundingBox() const { return AABB(); }
+	bool bounded() const { return false; }
+
+	int type() const { return SHAPE_PLANE; }
+	void params(float* p) const {
+		p[0] = normal.x(); p[1] = normal.y(); p[2] = normal.z(); p[3] = offset;
+		p[4] = p[5] = p[6] = p[7] = 0.0f;
+	}
+
+private:
+	Vec3 normal;
+	float offset;
+};
@@ -0,0 +1,52 @@
+#include "RenderOptions.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+
+#include "Sampler.h"
+
+RenderOptions parseRenderOptions(int argc, char** argv) {
+	RenderOptions options;
+
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if (arg.compare(0, 2, "--") != 0) continue; // argumento posicional
+
+		size_t eq = arg.find('=');
+		std::string name = arg.substr(2, eq == std::string::npos ? std::string::npos : eq - 2);
+		std::string value = (eq == std::string::npos) ? "" : arg.substr(eq + 1);
+
+		if (name == "sampler") options.sampler = value;
+		else if (name == "adaptive") options.adaptive = float(std::atof(value.c_str()));
+		else if (name == "adaptive-max") options.adaptiveMax = std::max(1, std::atoi(value.c_str()));
+		else if (name == "progressive") options.progressive = std::atof(value.c_str());
+		else if (name == "accel") options.accel = value;
+		else if (name == "stream") options.stream = value;
+		else if (name == "packet") options.packet = std::atoi(value.c_str());
+		else if (name == "prepass") options.prepass = std::atoi(value.c_str()) != 0;
+		else if (name == "ground-plane") options.groundPlane = std::atoi(value.c_str()) != 0;
+		else if (name == "scene-cache") options.sceneCache = std::atoi(value.c_str()) != 0;
+		else if (name == "accel-bench") options.accelBench = std::max(0, std::atoi(value.c_str()));
+		else std::cerr << "Aviso: opcion desconocida " << arg << std::endl;
+	}
+
+	Sampler* sampler = createSampler(options.sampler, 1);
+	if (!sampler) {
+		std::cerr << "Error: sampler desconocido: " << options.sampler << std::endl;
+		exit(-1);
+	}
+	delete sampler;
+
+	if (options.stream != "off" && options.stream != "unsorted" && options.stream != "sorted") {
+		std::cerr << "Error: modo de trazado por tandas desconocido: " << options.stream << std::endl;
+		exit(-1);
+	}
+
+	if (options.packet != 0 && options.packet != 4 && options.packet != 8) {
+		std::cerr << "Error: tamano de paquete no valido (4 u 8): " << options.packet << std::endl;
+		exit(-1);
+	}
+
+	return options;
+}
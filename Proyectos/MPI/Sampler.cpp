@@ -0,0 +1,170 @@
+#include "Sampler.h"
+
+#include <cmath>
+
+void Sampler::getCameraSamples(int frame, int x, int y, int first, int n, float* jx, float* jy, float* lx, float* ly) {
+	for (int s = 0; s < n; s++) {
+		startPixelSample(frame, x, y, first + s);
+		get2D(jx[s], jy[s]);
+		get2D(lx[s], ly[s]);
+	}
+}
+
+/*****************************************************************************/
+/* RandomSampler                                                             */
+/*****************************************************************************/
+
+void RandomSampler::startPixelSample(int frame, int x, int y, int sample, int dimension) {
+	randomInitSample(frame, x, y, sample, &local_rand_state);
+	for (int d = 0; d < dimension; d++) {
+		randomNext(&local_rand_state);
+	}
+	this->dimension = dimension;
+}
+
+/*****************************************************************************/
+/* SobolSampler                                                              */
+/*****************************************************************************/
+
+static inline uint32_t reverseBits(uint32_t x) {
+	x = (x << 16) | (x >> 16);
+	x = ((x & 0x00ff00ffu) << 8) | ((x & 0xff00ff00u) >> 8);
+	x = ((x & 0x0f0f0f0fu) << 4) | ((x & 0xf0f0f0f0u) >> 4);
+	x = ((x & 0x33333333u) << 2) | ((x & 0xccccccccu) >> 2);
+	x = ((x & 0x55555555u) << 1) | ((x & 0xaaaaaaaau) >> 1);
+	return x;
+}
+
+static inline uint32_t hash32(uint32_t x) {
+	x ^= x >> 16;
+	x *= 0x21f0aaadu;
+	x ^= x >> 15;
+	x *= 0x735a2d97u;
+	x ^= x >> 15;
+	return x;
+}
+
+static inline uint32_t hashCombine(uint32_t seed, uint32_t v) {
+	return seed ^ (v + (seed << 6) + (seed >> 2));
+}
+
+// Permutacion de Laine-Karras: cada bit solo depende de los bits de menor peso
+static inline uint32_t laineKarras(uint32_t x, uint32_t seed) {
+	x += seed;
+	x ^= x * 0x6c50b47cu;
+	x ^= x * 0xb82f1e52u;
+	x ^= x * 0xc7afe638u;
+	x ^= x * 0x8d22f6e6u;
+	return x;
+}
+
+// Scrambling de Owen: cada bit solo depende de los de mayor peso
+static inline uint32_t nestedUniformScramble(uint32_t x, uint32_t seed) {
+	return reverseBits(laineKarras(reverseBits(x), seed));
+}
+
+// Primeras dos dimensiones de Sobol (van der Corput y su pareja)
+static inline uint32_t sobol0(uint32_t index) {
+	return reverseBits(index);
+}
+
+static inline uint32_t sobol1(uint32_t index) {
+	uint32_t r = 0;
+	for (uint32_t v = 1u << 31; index; index >>= 1, v ^= v >> 1) {
+		if (index & 1) r ^= v;
+	}
+	return r;
+}
+
+static inline float toUnitFloat(uint32_t x) {
+	return (x >> 8) * (1.0f / 16777216.0f);
+}
+
+void SobolSampler::startPixelSample(int frame, int x, int y, int sample, int dimension) {
+	pixelSeed = hash32(hashCombine(hashCombine(hash32(uint32_t(frame)), uint32_t(x)), uint32_t(y)));
+	index = uint32_t(sample);
+	this->dimension = uint32_t(dimension);
+}
+
+float SobolSampler::get1D() {
+	uint32_t seed = hash32(hashCombine(pixelSeed, dimension));
+	dimension++;
+	uint32_t i = nestedUniformScramble(index, seed);
+	return toUnitFloat(nestedUniformScramble(sobol0(i), hashCombine(seed, 1)));
+}
+
+void SobolSampler::get2D(float& u1, float& u2) {
+	uint32_t seed = hash32(hashCombine(pixelSeed, dimension));
+	dimension += 2;
+	uint32_t i = nestedUniformScramble(index, seed);
+	u1 = toUnitFloat(nestedUniformScramble(sobol0(i), hashCombine(seed, 1)));
+	u2 = toUnitFloat(nestedUniformScramble(sobol1(i), hashCombine(seed, 2)));
+}
+
+/*****************************************************************************/
+/* CMJSampler                                                                */
+/*****************************************************************************/
+
+// Permutacion pseudoaleatoria de [0, l) elegida por p (Kensler)
+static uint32_t permute(uint32_t i, uint32_t l, uint32_t p) {
+	uint32_t w = l - 1;
+	w |= w >> 1;
+	w |= w >> 2;
+	w |= w >> 4;
+	w |= w >> 8;
+	w |= w >> 16;
+	do {
+		i ^= p; i *= 0xe170893du;
+		i ^= p >> 16;
+		i ^= (i & w) >> 4;
+		i ^= p >> 8; i *= 0x0929eb3fu;
+		i ^= p >> 23;
+		i ^= (i & w) >> 1; i *= 1 | p >> 27;
+		i *= 0x6935fa69u;
+		i ^= (i & w) >> 11; i *= 0x74dcb303u;
+		i ^= (i & w) >> 2; i *= 0x9e501cc3u;
+		i ^= (i & w) >> 2; i *= 0xc860a3dfu;
+		i &= w;
+		i ^= i >> 5;
+	} while (i >= l);
+	return (i + p) % l;
+}
+
+static float randfloat(uint32_t i, uint32_t p) {
+	i ^= p;
+	i ^= i >> 17; i ^= i >> 10; i *= 0xb36534e5u;
+	i ^= i >> 12; i ^= i >> 21; i *= 0x93fc4795u;
+	i ^= 0xdf6e307fu; i ^= i >> 17; i *= 1 | p >> 18;
+	return i * (1.0f / 4294967808.0f);
+}
+
+void CMJSampler::startPixelSample(int frame, int x, int y, int sample, int dimension) {
+	RandomSampler::startPixelSample(frame, x, y, sample, dimension);
+	pattern = hash32(hashCombine(hashCombine(hash32(uint32_t(frame)), uint32_t(x)), uint32_t(y)));
+	this->sample = sample;
+}
+
+void CMJSampler::get2D(float& u1, float& u2) {
+	bool pixelJitter = dimension == 0 && sample < n;
+	RandomSampler::get2D(u1, u2); // se consumen igual para no desplazar el resto de dimensiones
+	if (pixelJitter) {
+		// rejilla m x k lo mas cuadrada posible con m * k >= n
+		uint32_t N = uint32_t(n);
+		uint32_t m = uint32_t(std::sqrt(float(N)));
+		uint32_t k = (N + m - 1) / m;
+		uint32_t s = permute(uint32_t(sample), N, pattern * 0x51633e2du);
+		uint32_t sx = permute(s % m, m, pattern * 0xa511e9b3u);
+		uint32_t sy = permute(s / m, k, pattern * 0x63d83595u);
+		float jx = randfloat(s, pattern * 0xa399d265u);
+		float jy = randfloat(s, pattern * 0x711ad6a5u);
+		u1 = (s % m + (sy + jx) / k) / m;
+		u2 = (s / m + (sx + jy) / m) / k;
+	}
+}
+
+Sampler* createSampler(const std::string& name, int samplesPerPixel) {
+	if (name == "random") return new RandomSampler();
+	if (name == "sobol") return new SobolSampler();
+	if (name == "cmj") return new CMJSampler(samplesPerPixel);
+	return nullptr;
+}
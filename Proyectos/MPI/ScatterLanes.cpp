@@ -0,0 +1,64 @@
+#include "ScatterLanes.h"
+
+#include <algorithm>
+
+#include "Vec3x.h"
+
+static const int LANES = 8;
+
+// Rebota items[idx[0]], ..., items[idx[n - 1]], todos con materiales de tipo type. Los carriles
+// que sobran repiten el primer choque y no se guardan.
+static void scatterGroup(std::vector<ScatterItem>& items, const int* idx, int n, int type) {
+	Vec3xN<LANES> dir, p, normal, direction;
+	FloatxN<LANES> param;	// fuzz o indice de refraccion
+	float u[LANES][3];
+	Vec3 attenuation[LANES];
+	for (int k = 0; k < LANES; k++) {
+		const ScatterItem& it = items[idx[k < n ? k : 0]];
+		dir.set(k, it.ray.direction());
+		p.set(k, it.cd.p);
+		normal.set(k, it.cd.normal);
+		std::copy(it.u, it.u + 3, u[k]);
+
+		float prm[4];
+		const Material* m = it.hit->getMaterial();
+		if (type == MATERIAL_DIFFUSE) static_cast<const Diffuse*>(m)->Diffuse::params(prm);
+		else if (type == MATERIAL_METALLIC) static_cast<const Metallic*>(m)->Metallic::params(prm);
+		else static_cast<const Crystalline*>(m)->Crystalline::params(prm);
+		if (type == MATERIAL_CRYSTALLINE) {
+			attenuation[k] = Vec3(1.0, 1.0, 1.0);
+			param[k] = prm[0];
+		}
+		else {
+			attenuation[k] = Vec3(prm[0], prm[1], prm[2]);
+			param[k] = prm[3];
+		}
+	}
+
+	int alive = (1 << LANES) - 1;
+	if (type == MATERIAL_DIFFUSE) Diffuse::scatterLanes(p, normal, u, direction);
+	else if (type == MATERIAL_METALLIC) alive = Metallic::scatterLanes(dir, normal, param, u, direction);
+	else Crystalline::scatterLanes(dir, normal, param, u, direction);
+
+	for (int k = 0; k < n; k++) {
+		ScatterItem& it = items[idx[k]];
+		it.scattered = Ray(it.cd.p, direction.get(k));
+		it.attenuation = attenuation[k];
+		it.alive = (alive >> k) & 1;
+	}
+}
+
+void scatterLanes(std::vector<ScatterItem>& items) {
+	// indices de los choques de cada tipo; se reutilizan entre llamadas del mismo hilo
+	static thread_local std::vector<int> byType[MATERIAL_CRYSTALLINE + 1];
+	for (std::vector<int>& idx : byType) idx.clear();
+	for (size_t i = 0; i < items.size(); i++) {
+		if (items[i].lanes) byType[items[i].hit->materialType()].push_back(int(i));
+	}
+	for (int type = 0; type <= MATERIAL_CRYSTALLINE; type++) {
+		const std::vector<int>& idx = byType[type];
+		for (size_t g = 0; g < idx.size(); g += LANES) {
+			scatterGroup(items, &idx[g], std::min(LANES, int(idx.size() - g)), type);
+		}
+	}
+}
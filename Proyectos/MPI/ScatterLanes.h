@@ -0,0 +1,22 @@
+#pragma once
+
+#include <vector>
+
+#include "Object.h"
+
+// Choque de un camino del trazado por tandas, pendiente de rebotar
+struct ScatterItem {
+	Ray ray;
+	CollisionData cd;
+	Object* hit;
+	bool lanes;			// false: material sin version por carriles, ya rebotado con Object::scatter
+	float u[3];			// uniformes de scatter, ya sacadas del sampler del camino (Object::scatterSamples)
+	Ray scattered;		// salida: rayo rebotado y su atenuacion si alive
+	Vec3 attenuation;
+	bool alive;
+};
+
+// Rebota los choques de la tanda de LANES en LANES, agrupados por tipo de material, con las
+// cuentas de scatterLanes de cada material en Vec3xN. Da los mismos rayos que Object::scatter.
+// Los choques con lanes false se dejan como estan.
+void scatterLanes(std::vector<ScatterItem>& items);
@@ -0,0 +1,273 @@
+#include "SceneCache.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <vector>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "BVH.h"
+#include "Sphere.h"
+#include "Plane.h"
+
+static const char CACHE_MAGIC[8] = { 'R', 'T', 'C', 'A', 'C', 'H', 'E', '\0' };
+static const uint32_t CACHE_VERSION = 3;
+
+// Fichero: cabecera, numMaterials MaterialRecord (la tabla de materiales de la escena),
+// numObjects ObjectRecord (en el orden de las hojas si hay BVH, con los objetos infinitos
+// al final) y numNodes BVHNode
+struct CacheHeader {
+	char magic[8];
+	uint32_t version;
+	uint32_t recordSize;	// sizeof(ObjectRecord) y sizeof(BVHNode): detectan otro compilador u otra disposicion
+	uint32_t nodeSize;
+	uint32_t numObjects;
+	uint32_t numNodes;		// 0 si la estructura no es un BVH; entonces se construye al cargar
+	uint32_t numMaterials;
+	uint64_t sceneHash;
+};
+
+struct MaterialRecord {
+	int32_t type;
+	float params[4];
+};
+
+struct ObjectRecord {
+	int32_t shape;
+	int32_t material;	// indice en la tabla de materiales
+	float shapeParams[8];
+};
+
+static std::string cacheFileName(const std::string& sceneFile, const std::string& accel, const std::string& variant) {
+	return sceneFile + "." + accel + (variant.empty() ? "" : "." + variant) + ".cache";
+}
+
+// FNV-1a de 64 bits del contenido del fichero
+static bool hashFile(const std::string& filename, uint64_t& hash) {
+	std::ifstream file(filename, std::ios::binary);
+	if (!file.is_open()) return false;
+
+	hash = 14695981039346656037ull;
+	std::vector<char> buf(1 << 20);
+	while (file) {
+		file.read(buf.data(), buf.size());
+		std::streamsize n = file.gcount();
+		for (std::streamsize i = 0; i < n; i++) {
+			hash = (hash ^ (unsigned char)buf[i]) * 1099511628211ull;
+		}
+	}
+	return true;
+}
+
+// Proyecta en memoria el fichero entero, solo lectura
+static const char* mapFile(const std::string& filename, size_t& size) {
+#ifdef _WIN32
+	HANDLE file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE) return nullptr;
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0) {
+		CloseHandle(file);
+		return nullptr;
+	}
+	HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	CloseHandle(file);
+	if (!mapping) return nullptr;
+	const char* data = (const char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	CloseHandle(mapping);
+	size = size_t(fileSize.QuadPart);
+	return data;
+#else
+	int fd = open(filename.c_str(), O_RDONLY);
+	if (fd < 0) return nullptr;
+	struct stat st;
+	if (fstat(fd, &st) != 0 || st.st_size == 0) {
+		close(fd);
+		return nullptr;
+	}
+	void* data = mmap(nullptr, size_t(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (data == MAP_FAILED) return nullptr;
+	size = size_t(st.st_size);
+	return (const char*)data;
+#endif
+}
+
+static void unmapFile(const char* data, size_t size) {
+#ifdef _WIN32
+	UnmapViewOfFile(data);
+#else
+	munmap((void*)data, size);
+#endif
+}
+
+// Proyeccion de una cache con nodos de BVH: la escena la entrega a su arena, que la libera al
+// destruirse, cuando ya no queda ninguna copia de la escena que use los nodos
+struct MappedFile {
+	const char* data;
+	size_t size;
+
+	MappedFile(const char* data, size_t size) : data(data), size(size) {}
+	~MappedFile() { unmapFile(data, size); }
+};
+
+static bool knownMaterial(const MaterialRecord& r) {
+	return r.type >= MATERIAL_DIFFUSE && r.type <= MATERIAL_CRYSTALLINE;
+}
+
+static bool knownRecord(const ObjectRecord& r, uint32_t numMaterials) {
+	return (r.shape == SHAPE_SPHERE || r.shape == SHAPE_PLANE) && r.material >= 0 && uint32_t(r.material) < numMaterials;
+}
+
+// Sitio para un objeto con su forma, seguidos. Se reservan todos de una vez en la arena de la
+// escena y se construyen en paralelo (la arena no es segura entre hilos).
+struct ObjectSlot {
+	alignas(Sphere) alignas(Plane) unsigned char shape[std::max(sizeof(Sphere), sizeof(Plane))];
+	alignas(Object) unsigned char object[sizeof(Object)];
+};
+
+static Object* createObject(const ObjectRecord& r, Material* material, ObjectSlot& slot) {
+	const float* s = r.shapeParams;
+	Shape* shape;
+	if (r.shape == SHAPE_PLANE) shape = new (slot.shape) Plane(Vec3(s[0], s[1], s[2]), s[3]);
+	else shape = new (slot.shape) Sphere(Vec3(s[0], s[1], s[2]), s[3], Vec3(s[4], s[5], s[6]));
+	return new (slot.object) Object(shape, material);
+}
+
+bool loadSceneCache(const std::string& sceneFile, const std::string& accel, Scene& world, const std::string& variant) {
+	uint64_t hash;
+	if (!hashFile(sceneFile, hash)) return false;
+
+	size_t size = 0;
+	const char* data = mapFile(cacheFileName(sceneFile, accel, variant), size);
+	if (!data) return false;
+
+	CacheHeader header;
+	bool valid = size >= sizeof(header);
+	if (valid) {
+		std::memcpy(&header, data, sizeof(header));
+		valid = std::memcmp(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) == 0
+			&& header.version == CACHE_VERSION
+			&& header.recordSize == sizeof(ObjectRecord)
+			&& header.nodeSize == sizeof(BVHNode)
+			&& header.sceneHash == hash
+			&& size == sizeof(header) + uint64_t(header.numMaterials) * sizeof(MaterialRecord) + uint64_t(header.numObjects) * sizeof(ObjectRecord) + uint64_t(header.numNodes) * sizeof(BVHNode);
+	}
+
+	const MaterialRecord* materials = (const MaterialRecord*)(data + sizeof(header));
+	int numMaterials = valid ? int(header.numMaterials) : 0;
+	for (int i = 0; i < numMaterials && valid; i++) {
+		valid = knownMaterial(materials[i]);
+	}
+	const ObjectRecord* records = (const ObjectRecord*)(materials + numMaterials);
+	int n = valid ? int(header.numObjects) : 0;
+	for (int i = 0; i < n && valid; i++) {
+		valid = knownRecord(records[i], header.numMaterials);
+	}
+
+	Accelerator* a = nullptr;
+	if (valid && accel != "none") {
+		// "auto" solo guarda nodos cuando elige el BVH
+		a = createAccelerator(accel == "auto" ? "bvh" : accel);
+		valid = a && (header.numNodes == 0 || dynamic_cast<BVH*>(a));
+	}
+	if (!valid) {
+		delete a;
+		unmapFile(data, size);
+		return false;
+	}
+
+	std::vector<Material*> table(numMaterials);
+	for (int i = 0; i < numMaterials; i++) {
+		table[i] = world.getMaterial(world.addMaterial(materials[i].type, materials[i].params));
+	}
+
+	std::vector<Object*> ol(n);
+	ObjectSlot* slots = (ObjectSlot*)world.getArena().allocate(n * sizeof(ObjectSlot), alignof(ObjectSlot));
+	#pragma omp parallel for
+	for (int i = 0; i < n; i++) {
+		ol[i] = createObject(records[i], table[records[i].material], slots[i]);
+	}
+	for (Object* o : ol) world.add(o);
+
+	// los objetos infinitos no entran en la estructura
+	const std::vector<Object*>& bounded = world.getObjects();
+	// los nodos se usan desde la proyeccion mientras viva la escena; si no forman un arbol
+	// valido sobre los objetos se reconstruye la estructura
+	if (header.numNodes > 0 && static_cast<BVH*>(a)->attach((const BVHNode*)(records + n), int(header.numNodes), bounded)) {
+		world.getArena().own(new MappedFile(data, size));
+		world.setAccelerator(a);
+	}
+	else {
+		delete a;
+		a = chooseAccelerator(accel, bounded);
+		if (a) {
+			a->build(bounded);
+			world.setAccelerator(a);
+		}
+		unmapFile(data, size);
+	}
+	return true;
+}
+
+bool saveSceneCache(const std::string& sceneFile, const std::string& accel, const Scene& world, const std::string& variant) {
+	if (world.hasInstances()) return false;	// los clusters no caben en registros de objeto
+
+	CacheHeader header;
+	if (!hashFile(sceneFile, header.sceneHash)) return false;
+
+	const BVH* bvh = dynamic_cast<const BVH*>(world.getAccelerator());
+	std::vector<Object*> ol = bvh ? bvh->getLeafObjects() : world.getObjects();
+	ol.insert(ol.end(), world.getUnbounded().begin(), world.getUnbounded().end());
+
+	std::memcpy(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+	header.version = CACHE_VERSION;
+	header.recordSize = sizeof(ObjectRecord);
+	header.nodeSize = sizeof(BVHNode);
+	header.numObjects = uint32_t(ol.size());
+	header.numNodes = bvh ? uint32_t(bvh->nodeCount()) : 0;
+
+	const MaterialTable& table = world.getMaterials();
+	header.numMaterials = uint32_t(table.size());
+	std::vector<MaterialRecord> materials(table.size());
+	for (int i = 0; i < table.size(); i++) {
+		materials[i].type = table.get(i)->type();
+		table.get(i)->params(materials[i].params);
+	}
+
+	std::vector<ObjectRecord> records(ol.size());
+	for (size_t i = 0; i < ol.size(); i++) {
+		records[i].shape = ol[i]->getShape()->type();
+		ol[i]->getShape()->params(records[i].shapeParams);
+		records[i].material = table.find(ol[i]->getMaterial());
+		if (records[i].material < 0) return false;	// material que no esta en la tabla
+	}
+
+	std::string filename = cacheFileName(sceneFile, accel, variant);
+	std::string tmp = filename + ".tmp";
+	std::ofstream out(tmp, std::ios::binary);
+	if (!out.is_open()) return false;
+	out.write((const char*)&header, sizeof(header));
+	out.write((const char*)materials.data(), materials.size() * sizeof(MaterialRecord));
+	out.write((const char*)records.data(), records.size() * sizeof(ObjectRecord));
+	if (bvh) out.write((const char*)bvh->getNodes(), size_t(header.numNodes) * sizeof(BVHNode));
+	out.close();
+	if (!out) {
+		std::remove(tmp.c_str());
+		return false;
+	}
+
+	std::remove(filename.c_str());	// en Windows rename no sobrescribe
+	return std::rename(tmp.c_str(), filename.c_str()) == 0;
+}
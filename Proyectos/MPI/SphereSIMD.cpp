@@ -0,0 +1,192 @@
+#include "SphereSIMD.h"
+
+#include <limits>
+
+#include "PackedSphere.h"
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <immintrin.h>
+#define SPHERE_SIMD_SSE
+#endif
+
+// Las dos raices (nb - sqrt(disc)) / a y (nb + sqrt(disc)) / a. Raiz y division van en double,
+// como en Sphere::hitDistance (sqrt de un float promociona a double), para dar los mismos t.
+#if defined(__AVX__)
+static inline void roots(__m256 nb, __m256 disc, __m256 va, __m256& t1, __m256& t2) {
+	__m128 r1[2], r2[2];
+	__m128 h[3][2] = {
+		{ _mm256_castps256_ps128(nb), _mm256_extractf128_ps(nb, 1) },
+		{ _mm256_castps256_ps128(disc), _mm256_extractf128_ps(disc, 1) },
+		{ _mm256_castps256_ps128(va), _mm256_extractf128_ps(va, 1) } };
+	for (int k = 0; k < 2; k++) {
+		__m256d n = _mm256_cvtps_pd(h[0][k]);
+		__m256d s = _mm256_sqrt_pd(_mm256_cvtps_pd(h[1][k]));
+		__m256d a = _mm256_cvtps_pd(h[2][k]);
+		r1[k] = _mm256_cvtpd_ps(_mm256_div_pd(_mm256_sub_pd(n, s), a));
+		r2[k] = _mm256_cvtpd_ps(_mm256_div_pd(_mm256_add_pd(n, s), a));
+	}
+	t1 = _mm256_insertf128_ps(_mm256_castps128_ps256(r1[0]), r1[1], 1);
+	t2 = _mm256_insertf128_ps(_mm256_castps128_ps256(r2[0]), r2[1], 1);
+}
+#elif defined(SPHERE_SIMD_SSE)
+static inline void roots(__m128 nb, __m128 disc, __m128 va, __m128& t1, __m128& t2) {
+	__m128 r1[2], r2[2];
+	__m128 h[3][2] = {
+		{ nb, _mm_movehl_ps(nb, nb) },
+		{ disc, _mm_movehl_ps(disc, disc) },
+		{ va, va } };
+	for (int k = 0; k < 2; k++) {
+		__m128d n = _mm_cvtps_pd(h[0][k]);
+		__m128d s = _mm_sqrt_pd(_mm_cvtps_pd(h[1][k]));
+		__m128d a = _mm_cvtps_pd(h[2][k]);
+		r1[k] = _mm_cvtpd_ps(_mm_div_pd(_mm_sub_pd(n, s), a));
+		r2[k] = _mm_cvtpd_ps(_mm_div_pd(_mm_add_pd(n, s), a));
+	}
+	t1 = _mm_movelh_ps(r1[0], r1[1]);
+	t2 = _mm_movelh_ps(r2[0], r2[1]);
+}
+#endif
+
+void SphereSIMD::store(int k, Object* o) {
+	PackedSphere p = packSphere(o);
+	cx[k] = p.cx;
+	cy[k] = p.cy;
+	cz[k] = p.cz;
+	r2[k] = p.r2;
+	spheres[k] = o;
+}
+
+void SphereSIMD::build(const std::vector<Object*>& ol) {
+	spheres.clear();
+	others.clear();
+	slot.assign(ol.size(), -1);
+	int n = 0;
+	for (size_t i = 0; i < ol.size(); i++) {
+		if (ol[i]->getShape()->type() == SHAPE_SPHERE) slot[i] = n++;
+		else others.push_back(ol[i]);
+	}
+
+	int padded = (n + LANES - 1) / LANES * LANES;
+	cx.assign(padded, 0.0f);
+	cy.assign(padded, 0.0f);
+	cz.assign(padded, 0.0f);
+	r2.assign(padded, -std::numeric_limits<float>::max());
+	spheres.resize(n);
+	for (size_t i = 0; i < ol.size(); i++) {
+		if (slot[i] >= 0) store(slot[i], ol[i]);
+	}
+}
+
+bool SphereSIMD::refit(const std::vector<Object*>& ol, const std::vector<int>& moved) {
+	for (int i : moved) {
+		if (slot[i] >= 0) store(slot[i], ol[i]);
+	}
+	return true;
+}
+
+// Lee enteros los arrays de esferas y los objetos que no lo son
+Object* SphereSIMD::intersectCounted(const Ray& r, float t_min, float t_max, float& t, NodeCache& cache) const {
+	for (size_t g = 0; g < cx.size(); g += LANES) {
+		cache.touch(&cx[g]);
+		cache.touch(&cy[g]);
+		cache.touch(&cz[g]);
+		cache.touch(&r2[g]);
+	}
+	for (Object* obj : others) cache.touch(obj);
+	return intersect(r, t_min, t_max, t);
+}
+
+Object* SphereSIMD::intersect(const Ray& r, float t_min, float t_max, float& t) const {
+	Vec3 o = r.origin();
+	Vec3 d = r.direction();
+	float a = dot(d, d);
+	int best = -1;
+	t = t_max;
+
+#ifdef SPHERE_SIMD_SSE
+	// Cada carril guarda su distancia mas corta y el primer grupo en que la encontro
+	// (como float: exacto hasta 2^24 grupos); al final se queda el menor indice de esfera
+	float laneT[LANES], laneGroup[LANES];
+	int lanes = 4;
+	int groups = int(cx.size());
+#if defined(__AVX__)
+	lanes = 8;
+	{
+		__m256 ox = _mm256_set1_ps(o.x()), oy = _mm256_set1_ps(o.y()), oz = _mm256_set1_ps(o.z());
+		__m256 dx = _mm256_set1_ps(d.x()), dy = _mm256_set1_ps(d.y()), dz = _mm256_set1_ps(d.z());
+		__m256 va = _mm256_set1_ps(a);
+		__m256 tn = _mm256_set1_ps(t_min);
+		__m256 zero = _mm256_setzero_ps();
+		__m256 bestT = _mm256_set1_ps(t_max);
+		__m256 bestG = _mm256_set1_ps(-1.0f);
+		for (int g = 0; g < groups; g += 8) {
+			__m256 ocx = _mm256_sub_ps(ox, _mm256_loadu_ps(&cx[g]));
+			__m256 ocy = _mm256_sub_ps(oy, _mm256_loadu_ps(&cy[g]));
+			__m256 ocz = _mm256_sub_ps(oz, _mm256_loadu_ps(&cz[g]));
+			__m256 b = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(ocx, dx), _mm256_mul_ps(ocy, dy)), _mm256_mul_ps(ocz, dz));
+			__m256 c = _mm256_sub_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(ocx, ocx), _mm256_mul_ps(ocy, ocy)), _mm256_mul_ps(ocz, ocz)), _mm256_loadu_ps(&r2[g]));
+			__m256 disc = _mm256_sub_ps(_mm256_mul_ps(b, b), _mm256_mul_ps(va, c));
+			__m256 valid = _mm256_cmp_ps(disc, zero, _CMP_GT_OQ);
+			if (_mm256_movemask_ps(valid) == 0) continue;
+			__m256 t1, t2;
+			roots(_mm256_sub_ps(zero, b), disc, va, t1, t2);
+			__m256 th = _mm256_blendv_ps(t2, t1, _mm256_cmp_ps(t1, tn, _CMP_GT_OQ));
+			valid = _mm256_and_ps(valid, _mm256_and_ps(_mm256_cmp_ps(th, tn, _CMP_GT_OQ), _mm256_cmp_ps(th, bestT, _CMP_LT_OQ)));
+			bestT = _mm256_blendv_ps(bestT, th, valid);
+			bestG = _mm256_blendv_ps(bestG, _mm256_set1_ps(float(g)), valid);
+		}
+		_mm256_storeu_ps(laneT, bestT);
+		_mm256_storeu_ps(laneGroup, bestG);
+	}
+#else
+	{
+		__m128 ox = _mm_set1_ps(o.x()), oy = _mm_set1_ps(o.y()), oz = _mm_set1_ps(o.z());
+		__m128 dx = _mm_set1_ps(d.x()), dy = _mm_set1_ps(d.y()), dz = _mm_set1_ps(d.z());
+		__m128 va = _mm_set1_ps(a);
+		__m128 tn = _mm_set1_ps(t_min);
+		__m128 zero = _mm_setzero_ps();
+		__m128 bestT = _mm_set1_ps(t_max);
+		__m128 bestG = _mm_set1_ps(-1.0f);
+		for (int g = 0; g < groups; g += 4) {
+			__m128 ocx = _mm_sub_ps(ox, _mm_loadu_ps(&cx[g]));
+			__m128 ocy = _mm_sub_ps(oy, _mm_loadu_ps(&cy[g]));
+			__m128 ocz = _mm_sub_ps(oz, _mm_loadu_ps(&cz[g]));
+			__m128 b = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ocx, dx), _mm_mul_ps(ocy, dy)), _mm_mul_ps(ocz, dz));
+			__m128 c = _mm_sub_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(ocx, ocx), _mm_mul_ps(ocy, ocy)), _mm_mul_ps(ocz, ocz)), _mm_loadu_ps(&r2[g]));
+			__m128 disc = _mm_sub_ps(_mm_mul_ps(b, b), _mm_mul_ps(va, c));
+			__m128 valid = _mm_cmpgt_ps(disc, zero);
+			if (_mm_movemask_ps(valid) == 0) continue;
+			__m128 t1, t2;
+			roots(_mm_sub_ps(zero, b), disc, va, t1, t2);
+			__m128 first = _mm_cmpgt_ps(t1, tn);
+			__m128 th = _mm_or_ps(_mm_and_ps(first, t1), _mm_andnot_ps(first, t2));
+			valid = _mm_and_ps(valid, _mm_and_ps(_mm_cmpgt_ps(th, tn), _mm_cmplt_ps(th, bestT)));
+			bestT = _mm_or_ps(_mm_and_ps(valid, th), _mm_andnot_ps(valid, bestT));
+			bestG = _mm_or_ps(_mm_and_ps(valid, _mm_set1_ps(float(g))), _mm_andnot_ps(valid, bestG));
+		}
+		_mm_storeu_ps(laneT, bestT);
+		_mm_storeu_ps(laneGroup, bestG);
+	}
+#endif
+	for (int k = 0; k < lanes; k++) {
+		if (laneGroup[k] < 0.0f) continue;
+		int idx = int(laneGroup[k]) + k;
+		if (laneT[k] < t || (laneT[k] == t && idx < best)) {
+			t = laneT[k];
+			best = idx;
+		}
+	}
+#else
+	for (int k = 0; k < int(spheres.size()); k++) {
+		if (spheres[k]->hitDistance(r, t_min, t, t)) best = k;
+	}
+#endif
+
+	Object* hit = best >= 0 ? spheres[best] : nullptr;
+	for (Object* obj : others) {
+		if (obj->hitDistance(r, t_min, t, t)) {
+			hit = obj;
+		}
+	}
+	return hit;
+}
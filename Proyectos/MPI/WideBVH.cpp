@@ -0,0 +1,211 @@
+#include "WideBVH.h"
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <immintrin.h>
+#define WIDE_BVH_SSE
+#endif
+
+template <int W>
+void WideBVH<W>::build(const std::vector<Object*>& ol) {
+	nodes.clear();
+	objects.clear();
+	stackSize = 0;
+
+	BVH bvh;
+	bvh.build(ol);
+	if (bvh.empty()) return;
+	objects = bvh.getLeafObjects();
+	packSpheres(objects, spheres);
+
+	nodes.emplace_back();
+	collapse(bvh.getNodes(), 0, 0, 0);
+}
+
+template <int W>
+void WideBVH<W>::collapse(const BVHNode* bin, int binIdx, int wideIdx, int depth) {
+	stackSize = std::max(stackSize, (W - 1) * depth + W);
+	int cand[W];
+	int n = 0;
+	if (bin[binIdx].isLeaf()) {
+		cand[n++] = binIdx;
+	}
+	else {
+		cand[n++] = bin[binIdx].leftFirst;
+		cand[n++] = bin[binIdx].leftFirst + 1;
+	}
+	while (n < W) {
+		int best = -1;
+		float bestArea = -1.0f;
+		for (int k = 0; k < n; k++) {
+			const BVHNode& c = bin[cand[k]];
+			if (!c.isLeaf() && c.bounds.surfaceArea() > bestArea) {
+				best = k;
+				bestArea = c.bounds.surfaceArea();
+			}
+		}
+		if (best < 0) break;
+		int b = cand[best];
+		cand[best] = bin[b].leftFirst;
+		cand[n++] = bin[b].leftFirst + 1;
+	}
+
+	for (int k = 0; k < W; k++) {
+		WideBVHNode<W>& node = nodes[wideIdx];
+		for (int a = 0; a < 3; a++) {
+			node.bounds[0][a][k] = k < n ? bin[cand[k]].bounds.min[a] : std::numeric_limits<float>::max();
+			node.bounds[1][a][k] = k < n ? bin[cand[k]].bounds.max[a] : -std::numeric_limits<float>::max();
+		}
+		node.child[k] = 0;
+		node.count[k] = 0;
+		if (k < n && bin[cand[k]].isLeaf()) {
+			node.child[k] = -bin[cand[k]].leftFirst - 1;
+			node.count[k] = bin[cand[k]].count;
+		}
+	}
+	// los hijos internos se anaden despues: emplace_back puede mover el vector
+	for (int k = 0; k < n; k++) {
+		if (bin[cand[k]].isLeaf()) continue;
+		int idx = int(nodes.size());
+		nodes.emplace_back();
+		nodes[wideIdx].child[k] = idx;
+		collapse(bin, cand[k], idx, depth + 1);
+	}
+}
+
+// Test de slabs del rayo contra los W hijos del nodo. near[a] = 1 si la direccion es
+// negativa en el eje a (se entra por el maximo). Deja en tNear la distancia de entrada
+// y devuelve la mascara de hijos cortados en (t_min, t_max).
+template <int W>
+static inline int intersectChildren(const WideBVHNode<W>& node, const float* origin, const float* invDir,
+	const int* near, float t_min, float t_max, float* tNear) {
+#if defined(__AVX__)
+	if (W == 8) {
+		__m256 tn = _mm256_set1_ps(t_min);
+		__m256 tf = _mm256_set1_ps(t_max);
+		for (int a = 0; a < 3; a++) {
+			__m256 o = _mm256_set1_ps(origin[a]);
+			__m256 id = _mm256_set1_ps(invDir[a]);
+			tn = _mm256_max_ps(tn, _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(node.bounds[near[a]][a]), o), id));
+			tf = _mm256_min_ps(tf, _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(node.bounds[1 - near[a]][a]), o), id));
+		}
+		_mm256_storeu_ps(tNear, tn);
+		return _mm256_movemask_ps(_mm256_cmp_ps(tn, tf, _CMP_LE_OQ));
+	}
+#endif
+#ifdef WIDE_BVH_SSE
+	// de 4 en 4 hijos (sin AVX, el nodo de 8 se hace en dos pasos)
+	int mask = 0;
+	for (int c = 0; c < W; c += 4) {
+		__m128 tn = _mm_set1_ps(t_min);
+		__m128 tf = _mm_set1_ps(t_max);
+		for (int a = 0; a < 3; a++) {
+			__m128 o = _mm_set1_ps(origin[a]);
+			__m128 id = _mm_set1_ps(invDir[a]);
+			tn = _mm_max_ps(tn, _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.bounds[near[a]][a] + c), o), id));
+			tf = _mm_min_ps(tf, _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.bounds[1 - near[a]][a] + c), o), id));
+		}
+		_mm_storeu_ps(tNear + c, tn);
+		mask |= _mm_movemask_ps(_mm_cmple_ps(tn, tf)) << c;
+	}
+	return mask;
+#else
+	int mask = 0;
+	for (int k = 0; k < W; k++) {
+		float tn = t_min, tf = t_max;
+		for (int a = 0; a < 3; a++) {
+			tn = std::max(tn, (node.bounds[near[a]][a][k] - origin[a]) * invDir[a]);
+			tf = std::min(tf, (node.bounds[1 - near[a]][a][k] - origin[a]) * invDir[a]);
+		}
+		tNear[k] = tn;
+		if (tn <= tf) mask |= 1 << k;
+	}
+	return mask;
+#endif
+}
+
+template <int W>
+template <bool COUNT>
+Object* WideBVH<W>::traverse(const Ray& r, float t_min, float t_max, float& closest, NodeCache* cache) const {
+	if (nodes.empty()) return nullptr;
+
+	float origin[3], invDir[3];
+	int near[3];
+	for (int a = 0; a < 3; a++) {
+		origin[a] = r.origin()[a];
+		invDir[a] = 1.0f / r.direction()[a];
+		near[a] = invDir[a] < 0.0f ? 1 : 0;
+	}
+
+	Object* hit = nullptr;
+	closest = t_max;
+
+	struct Entry {
+		int child;
+		int count;
+		float t;
+	};
+	Entry local[STACK_SIZE];
+	std::vector<Entry> heap;
+	Entry* stack = local;
+	if (stackSize > STACK_SIZE) {
+		heap.resize(stackSize);
+		stack = heap.data();
+	}
+	int sp = 0;
+	stack[sp++] = { 0, 0, t_min };
+
+	while (sp > 0) {
+		Entry e = stack[--sp];
+		if (e.t > closest) continue;	// ya hay un choque antes de entrar en su caja
+
+		if (e.child < 0) {
+			int first = -e.child - 1;
+			for (int i = first; COUNT && i < first + e.count; i++) {
+				cache->touch(&spheres[i]);
+				if (spheres[i].r2 < 0.0f) {
+					cache->touch(&objects[i]);
+					cache->touch(objects[i]);
+				}
+			}
+			int i = hitPackedRun(&spheres[first], &objects[first], e.count, r, t_min, closest);
+			if (i >= 0) hit = objects[first + i];
+			continue;
+		}
+
+		const WideBVHNode<W>& node = nodes[e.child];
+		if (COUNT) cache->touchRange(&node, sizeof(node));	// 128 bytes con W = 4, 256 con W = 8
+		float tNear[W];
+		int mask = intersectChildren(node, origin, invDir, near, t_min, closest, tNear);
+
+		// se apilan de mas lejano a mas cercano para visitar primero el mas cercano
+		int order[W];
+		int m = 0;
+		for (int k = 0; k < W; k++) {
+			if (!(mask & (1 << k))) continue;
+			int p = m++;
+			while (p > 0 && tNear[order[p - 1]] < tNear[k]) {
+				order[p] = order[p - 1];
+				p--;
+			}
+			order[p] = k;
+		}
+		for (int q = 0; q < m; q++) {
+			int k = order[q];
+			stack[sp++] = { node.child[k], node.count[k], tNear[k] };
+		}
+	}
+	return hit;
+}
+
+template <int W>
+Object* WideBVH<W>::intersect(const Ray& r, float t_min, float t_max, float& t) const {
+	return traverse<false>(r, t_min, t_max, t, nullptr);
+}
+
+template <int W>
+Object* WideBVH<W>::intersectCounted(const Ray& r, float t_min, float t_max, float& t, NodeCache& cache) const {
+	return traverse<true>(r, t_min, t_max, t, &cache);
+}
+
+template class WideBVH<4>;
+template class WideBVH<8>;
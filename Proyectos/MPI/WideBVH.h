@@ -0,0 +1,46 @@
+#pragma once
+
+#include <vector>
+
+#include "AABB.h"
+#include "Accelerator.h"
+#include "BVH.h"
+
+// Nodo de W hijos con las cajas en SoA: bounds[0] = minimos y bounds[1] = maximos, por eje,
+// de modo que una sola instruccion SIMD prueba el rayo contra 4 (SSE) u 8 (AVX) hijos.
+// child >= 0: nodo interno; child < 0: hoja con count objetos desde -child - 1.
+// Los huecos tienen la caja invertida y no los corta ningun rayo.
+template <int W>
+struct WideBVHNode {
+	float bounds[2][3][W];
+	int child[W];
+	int count[W];
+};
+
+// BVH de W hijos por nodo (4 u 8), obtenido colapsando el BVH SAH binario: en cada nodo se
+// abre el hijo interno de mayor area hasta reunir W hijos.
+template <int W>
+class WideBVH : public Accelerator {
+public:
+	WideBVH() : stackSize(0) {}
+
+	void build(const std::vector<Object*>& ol);
+	Object* intersect(const Ray& r, float t_min, float t_max, float& t) const;
+	Object* intersectCounted(const Ray& r, float t_min, float t_max, float& t, NodeCache& cache) const;
+
+	int nodeCount() const { return int(nodes.size()); }
+
+private:
+	// pila del recorrido en el marco; los arboles mas profundos la piden al heap
+	static const int STACK_SIZE = 64 * W;
+
+	void collapse(const BVHNode* bin, int binIdx, int wideIdx, int depth);
+
+	std::vector<WideBVHNode<W> > nodes;
+	int stackSize;	// entradas que necesita el recorrido: (W - 1) por nivel mas los W hijos del ultimo
+	std::vector<Object*> objects;	// en el orden de las hojas
+	std::vector<PackedSphere> spheres;	// paralelo a objects
+
+	template <bool COUNT>
+	Object* traverse(const Ray& r, float t_min, float t_max, float& closest, NodeCache* cache) const;
+};
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "Object.h"
+
+// Cache de datos simulada (directa, 512 lineas de 64 bytes = 32 KB, como una L1) a la que se
+// pasan las direcciones que lee un recorrido. Sus fallos aproximan los de la cache real sin
+// depender de contadores hardware, y sirven para comparar ordenes de trazado.
+struct NodeCache {
+	static const int LINES = 512;
+	uintptr_t tag[LINES];
+	long long misses;
+
+	NodeCache() : misses(0) {
+		for (int i = 0; i < LINES; i++) tag[i] = ~uintptr_t(0);
+	}
+
+	void touch(const void* p) {
+		uintptr_t line = uintptr_t(p) >> 6;
+		uintptr_t& t = tag[line % LINES];
+		if (t != line) {
+			t = line;
+			misses++;
+		}
+	}
+
+	// todas las lineas de [p, p + bytes)
+	void touchRange(const void* p, size_t bytes) {
+		for (uintptr_t line = uintptr_t(p) >> 6; line <= (uintptr_t(p) + bytes - 1) >> 6; line++) touch((const void*)(line << 6));
+	}
+};
+
+// Estructura de aceleracion para buscar el choque mas cercano de un rayo con los objetos
+// de la escena. Se construye una vez y despues solo se consulta (la comparten los hilos);
+// entre fotogramas puede reajustarse a los objetos que se mueven.
+class Accelerator {
+public:
+	virtual ~Accelerator() {}
+
+	virtual void build(const std::vector<Object*>& ol) = 0;
+
+	// Objeto mas cercano en (t_min, t_max) o nullptr; t queda con la distancia de ese choque.
+	// Punto y normal no se calculan aqui: se piden al objeto devuelto con hitAttributes.
+	virtual Object* intersect(const Ray& r, float t_min, float t_max, float& t) const = 0;
+
+	// Choque mas cercano de n rayos (como mucho MAX_PACKET). Por defecto rayo a rayo;
+	// las estructuras que lo admiten recorren el paquete entero con decisiones compartidas.
+	virtual void intersectPacket(const Ray* rays, int n, float t_min, float t_max, Object** hits, float* t) const {
+		for (int k = 0; k < n; k++) {
+			hits[k] = intersect(rays[k], t_min, t_max, t[k]);
+		}
+	}
+
+	static const int MAX_PACKET = 64;
+
+	// Como intersect, pasando por cache los nodos y objetos que lee
+	virtual Object* intersectCounted(const Ray& r, float t_min, float t_max, float& t, NodeCache& cache) const = 0;
+
+	// Reajuste tras mover los objetos ol[i], i en moved (ol es la lista con la que se construyo).
+	// Devuelve false si no sabe reajustarse o si la calidad ha empeorado tanto que conviene
+	// reconstruir; entonces hay que llamar a build.
+	virtual bool refit(const std::vector<Object*>& ol, const std::vector<int>& moved) { return false; }
+};
+
+// "bvh", "lbvh", "bvh4", "bvh8", "grid" o "simd"; nullptr si el nombre no se conoce
+Accelerator* createAccelerator(const std::string& name);
+
+// Hasta este numero de objetos, si todos son esferas, probarlas todas con SIMD es mas rapido
+// que cualquier arbol (medido con 1 hilo a 256x256 y 16 muestras por pixel: con esferas
+// repartidas como en randomScene() el BVH de 4 hijos empata hacia las 64-128). Con RT_AVX el
+// kernel de 8 carriles no sube el cruce: la raiz en double de 8 carriles cuesta como dos de 4 y
+// hay menos grupos sin ningun choque que saltarse, asi que sale algo mas lento que con SSE.
+static const int SIMD_MAX_SPHERES = 64;
+
+// Estructura para los objetos ol: la pedida, y con "auto" "simd" si son pocas esferas y
+// "bvh" si no. nullptr para "none" (recorrido lineal) o si el nombre no se conoce.
+Accelerator* chooseAccelerator(const std::string& name, const std::vector<Object*>& ol);
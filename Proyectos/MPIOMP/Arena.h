@@ -0,0 +1,82 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include <utility>
+#include <vector>
+
+// Memoria de una escena. Objetos, formas y materiales se construyen uno detras de otro en
+// bloques grandes, en el orden en que se crean, y se liberan todos juntos al destruir la
+// arena: una reserva por bloque en vez de un new por pieza, y los datos de cada objeto quedan
+// seguidos en memoria.
+// make no llama despues al destructor, asi que es solo para clases sin memoria propia
+// (Object, las formas y los materiales). Lo que si la tiene (clusters, estructuras de
+// aceleracion) se crea con new y se entrega con own, que lo borra al destruir la arena.
+// No es segura entre hilos: se usa al cargar y al preparar los fotogramas, no al trazar.
+class Arena {
+public:
+	static const size_t BLOCK_SIZE = 1 << 20;
+
+	Arena() : cur(nullptr), left(0) {}
+	Arena(const Arena&) = delete;
+	Arena& operator=(const Arena&) = delete;
+	~Arena() {
+		for (size_t i = owned.size(); i-- > 0;) owned[i].destroy(owned[i].p);
+		for (char* b : blocks) free(b);
+	}
+
+	// size bytes alineados a align. Lo que no cabe en un cuarto de bloque va en un bloque
+	// propio, sin tirar lo que queda del bloque actual.
+	void* allocate(size_t size, size_t align = alignof(std::max_align_t)) {
+		if (size + align > BLOCK_SIZE / 4) return alignUp(newBlock(size + align), align);
+		char* p = alignUp(cur, align);
+		if (!cur || size_t(p - cur) + size > left) {
+			cur = newBlock(BLOCK_SIZE);
+			left = BLOCK_SIZE;
+			p = alignUp(cur, align);
+		}
+		left -= size_t(p - cur) + size;
+		cur = p + size;
+		return p;
+	}
+
+	template <class T, class... Args>
+	T* make(Args&&... args) {
+		return new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+	}
+
+	// La arena pasa a ser duena de p (creado con new)
+	template <class T>
+	T* own(T* p) {
+		if (p) owned.push_back({ p, [](void* q) { delete static_cast<T*>(q); } });
+		return p;
+	}
+
+private:
+	struct Owned {
+		void* p;
+		void (*destroy)(void*);
+	};
+
+	char* newBlock(size_t bytes) {
+		char* b = (char*)malloc(bytes);
+		if (!b) {
+			std::cerr << "Error: sin memoria para la escena (" << bytes << " bytes)" << std::endl;
+			exit(-1);
+		}
+		blocks.push_back(b);
+		return b;
+	}
+	static char* alignUp(char* p, size_t align) {
+		return (char*)((uintptr_t(p) + align - 1) / align * align);
+	}
+
+	std::vector<char*> blocks;
+	std::vector<Owned> owned;
+	char* cur;	// siguiente byte libre del bloque actual
+	size_t left;	// bytes libres desde cur
+};
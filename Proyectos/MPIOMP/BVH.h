@@ -0,0 +1,92 @@
+#pragma once
+
+#include <vector>
+
+#include "AABB.h"
+#include "Accelerator.h"
+#include "PackedSphere.h"
+
+// Nodo de 32 bytes. Interior: hijos en leftFirst y leftFirst + 1, count = 0.
+// Hoja: objetos [leftFirst, leftFirst + count) de BVH::objects.
+struct BVHNode {
+	AABB bounds;
+	int leftFirst;
+	int count;
+
+	bool isLeaf() const { return count > 0; }
+};
+
+// Jerarquia de volumenes envolventes sobre los objetos de la escena, construida con
+// la heuristica de area (SAH) evaluada por cubetas sobre los centroides.
+class BVH : public Accelerator {
+public:
+	BVH() : nodeData(nullptr), numNodes(0), stackSize(0), sahSum(0.0), buildCost(0.0) {}
+
+	void build(const std::vector<Object*>& ol);
+	Object* intersect(const Ray& r, float t_min, float t_max, float& t) const;
+
+	// Recorrido de paquete: se baja por un nodo si lo corta algun rayo activo y se prueba
+	// desde el primero que lo corta (los anteriores ya no lo necesitan)
+	void intersectPacket(const Ray* rays, int n, float t_min, float t_max, Object** hits, float* t) const;
+	Object* intersectCounted(const Ray& r, float t_min, float t_max, float& t, NodeCache& cache) const;
+
+	// Reajuste de abajo arriba: solo se recalculan las hojas de los objetos movidos y sus
+	// antecesores, y con ellos el coste SAH. Pide reconstruir si ese coste pasa de
+	// REFIT_MAX_GROWTH veces el que tenia el arbol recien construido.
+	bool refit(const std::vector<Object*>& ol, const std::vector<int>& moved);
+
+	// Usa nodos ya construidos (p. ej. proyectados en memoria desde la cache) sin copiarlos;
+	// leafObjects en el orden de las hojas. Los nodos deben seguir vivos mientras se use el BVH.
+	// Devuelve false si no forman un arbol valido sobre leafObjects (cache corrupta).
+	bool attach(const BVHNode* data, int count, const std::vector<Object*>& leafObjects);
+
+	bool empty() const { return numNodes == 0; }
+	int nodeCount() const { return numNodes; }
+	const BVHNode* getNodes() const { return nodeData; }
+	const std::vector<Object*>& getLeafObjects() const { return objects; }
+
+protected:
+	// apunta nodeData a los nodos recien construidos y empaqueta las esferas de las hojas
+	void finish() { nodeData = nodes.data(); numNodes = int(nodes.size()); parent.clear(); packSpheres(objects, spheres); stackSize = measureStack(); }
+	// nodeData pasa a los nodos propios si los hay (al reajustar se copian los de la cache)
+	void rebind() { if (!nodes.empty()) nodeData = nodes.data(); }
+
+	std::vector<BVHNode> nodes;
+	std::vector<Object*> objects;	// en el orden de las hojas
+	std::vector<PackedSphere> spheres;	// paralelo a objects
+	std::vector<int> slotOf;		// posicion en objects de cada objeto de la lista de build
+	const BVHNode* nodeData;
+	int numNodes;
+	int stackSize;	// entradas de pila que necesita el recorrido: profundidad + 1
+
+	// Recorre el arbol desde la raiz y devuelve la pila que necesita, o -1 si algun indice
+	// se sale de los nodos o de objects o algun nodo se alcanza dos veces
+	int measureStack() const;
+
+private:
+	// pila de los recorridos en el marco; los arboles mas profundos (SAH degenerado) la piden al heap
+	static const int STACK_SIZE = 128;
+
+	struct BuildPrim {
+		AABB bounds;
+		Vec3 centroid;
+		Object* object;
+		int index;	// en la lista de build
+	};
+
+	void subdivide(int nodeIdx, std::vector<BuildPrim>& prims, int first, int count);
+
+	// Estado del reajuste, preparado la primera vez que se reajusta tras construir
+	bool prepareRefit();
+	float nodeCost(const BVHNode& node) const;
+
+	std::vector<int> parent;	// padre de cada nodo (-1 la raiz)
+	std::vector<int> level;		// profundidad de cada nodo
+	std::vector<int> leafOf;	// hoja de cada posicion de objects
+	std::vector<char> dirty;
+	double sahSum;		// suma de nodeCost de todos los nodos
+	double buildCost;	// sahSum / area de la raiz al preparar el reajuste
+
+	template <bool COUNT>
+	Object* traverse(const Ray& r, float t_min, float t_max, float& closest, NodeCache* cache) const;
+};
@@ -1,6 +1,6 @@
 #include "Crystalline.h"
 
-bool Crystalline::scatter(const Ray& r_in, const CollisionData& cd, Vec3& attenuation, Ray& scattered) const {
+bool Crystalline::scatter(const Ray& r_in, const CollisionData& cd, Vec3& attenuation, Ray& scattered, Sampler* sampler) const {
 	Vec3 outward_normal;
 	Vec3 reflected = reflect(r_in.direction(), cd.normal);
 	float ni_over_nt;
@@ -24,7 +24,7 @@ bool Crystalline::scatter(const Ray& r_in, const CollisionData& cd, Vec3& attenu
 		reflect_prob = schlick(cosine, ref_idx);
 	else
 		reflect_prob = 1.0;
-	if (Mirandom() < reflect_prob)
+	if (sampler->get1D() < reflect_prob)
 		scattered = Ray(cd.p, reflected);
 	else
 		scattered = Ray(cd.p, refracted);
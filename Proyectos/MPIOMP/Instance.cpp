@@ -0,0 +1,67 @@
+#include "Instance.h"
+
+#include <limits>
+
+static const float PI = 3.14159265358979f;
+
+bool Cluster::add(Object* o) {
+	if (!o->bounded() || o->moving()) return false;
+	ol.push_back(o);
+	packed.push_back(packSphere(o));
+	bounds.grow(o->boundingBox());
+	return true;
+}
+
+void Cluster::build(const std::string& name) {
+	delete accel;
+	accel = nullptr;
+	if (name == "none") return;
+	accel = chooseAccelerator(name, ol);
+	if (accel) accel->build(ol);
+}
+
+Object* Cluster::closestHit(const Ray& r, float t_min, float t_max, float& t) const {
+	if (accel) return accel->intersect(r, t_min, t_max, t);
+	t = t_max;
+	int i = hitPackedRun(packed.data(), ol.data(), int(ol.size()), r, t_min, t);
+	return i >= 0 ? ol[i] : nullptr;
+}
+
+Instance::Instance(const Cluster* cluster, Vec3 offset, float scale, float angle) : cluster(cluster), offset(offset), scale(scale), angle(angle) {
+	cosA = cosf(angle * PI / 180.0f);
+	sinA = sinf(angle * PI / 180.0f);
+}
+
+bool Instance::hitDistance(const Ray& ray, float t_min, float t_max, float& t) const {
+	float tHit;
+	if (!cluster->closestHit(localRay(ray), t_min, t_max, tHit)) return false;
+	t = tHit;
+	return true;
+}
+
+// Se vuelve a buscar el choque en el cluster desde el mismo t_min y sin limite: el mas cercano
+// es el que dio la distancia t en hitDistance. Un margen estrecho alrededor de t no sirve,
+// porque con rayos rasantes la raiz de la esfera puede quedar fuera de la caja de su hoja.
+// Los datos del choque salen de esta busqueda, asi que van siempre con el objeto devuelto.
+// Si aun asi no lo encuentra, el rayo cuenta como fallo en vez de parar el render.
+Object* Instance::innerHit(const Ray& ray, float t_min, CollisionData& cd) const {
+	Ray local = localRay(ray);
+	float tHit;
+	Object* hit = cluster->closestHit(local, t_min, std::numeric_limits<float>::max(), tHit);
+	if (!hit) return nullptr;
+	hit = hit->hitAttributes(local, t_min, tHit, cd);
+	cd.p = ray.point_at_parameter(tHit);
+	cd.normal = toWorld(cd.normal);
+	return hit;
+}
+
+AABB Instance::boundingBox() const {
+	AABB local = cluster->boundingBox();
+	AABB b;
+	for (int k = 0; k < 8; k++) {
+		Vec3 c((k & 1) ? local.max.x() : local.min.x(), (k & 2) ? local.max.y() : local.min.y(), (k & 4) ? local.max.z() : local.min.z());
+		c *= scale;
+		b.grow(offset + Vec3(cosA * c.x() + sinA * c.z(), c.y(), -sinA * c.x() + cosA * c.z()));
+	}
+	return b;
+}
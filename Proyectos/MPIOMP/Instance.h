@@ -0,0 +1,67 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "Accelerator.h"
+#include "PackedSphere.h"
+
+// Grupo de objetos que se repite en la escena. Se guarda una sola vez, con su propia
+// estructura de aceleracion (nivel inferior), y cada copia es una Instance que lo referencia.
+class Cluster {
+public:
+	Cluster() : accel(nullptr) {}
+	~Cluster() { delete accel; }
+	Cluster(const Cluster&) = delete;
+	Cluster& operator=(const Cluster&) = delete;
+
+	// Solo objetos con caja y quietos
+	bool add(Object* o);
+	// Estructura de aceleracion del cluster, con los mismos nombres que Scene::build
+	void build(const std::string& name);
+
+	// Objeto mas cercano en (t_min, t_max), en coordenadas del cluster; t queda con su distancia
+	Object* closestHit(const Ray& r, float t_min, float t_max, float& t) const;
+
+	AABB boundingBox() const { return bounds; }
+	size_t size() const { return ol.size(); }
+
+private:
+	std::vector<Object*> ol;
+	std::vector<PackedSphere> packed;	// paralelo a ol
+	Accelerator* accel;
+	AABB bounds;
+};
+
+// Copia de un cluster trasladada a offset, escalada por scale y girada angle grados alrededor
+// del eje Y. El rayo se pasa a coordenadas del cluster con su direccion transformada igual que
+// el origen, asi que la distancia t es la misma en los dos espacios.
+// Como objeto de la escena lleva material nulo: el material es el del objeto del cluster que
+// se corta, que devuelve innerHit.
+class Instance : public Shape {
+public:
+	Instance(const Cluster* cluster, Vec3 offset, float scale, float angle);
+
+	bool hitDistance(const Ray& ray, float t_min, float t_max, float& t) const;
+	void hitAttributes(const Ray& ray, float t, CollisionData& cd) const { innerHit(ray, 0.0f, cd); }
+	Object* innerHit(const Ray& ray, float t_min, CollisionData& cd) const;
+	AABB boundingBox() const;
+
+	int type() const { return SHAPE_INSTANCE; }
+	void params(float* p) const {
+		p[0] = offset.x(); p[1] = offset.y(); p[2] = offset.z(); p[3] = scale; p[4] = angle;
+		p[5] = p[6] = p[7] = 0.0f;
+	}
+
+private:
+	const Cluster* cluster;
+	Vec3 offset;
+	float scale;
+	float angle;
+	float cosA, sinA;
+
+	// de la escena al cluster (vectores: sin traslacion) y del cluster a la escena
+	Vec3 toLocal(const Vec3& v) const { return Vec3(cosA * v.x() - sinA * v.z(), v.y(), sinA * v.x() + cosA * v.z()) / scale; }
+	Vec3 toWorld(const Vec3& v) const { return Vec3(cosA * v.x() + sinA * v.z(), v.y(), -sinA * v.x() + cosA * v.z()); }
+	Ray localRay(const Ray& ray) const { return Ray(toLocal(ray.origin() - offset), toLocal(ray.direction())); }
+};
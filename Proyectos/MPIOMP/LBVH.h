@@ -0,0 +1,25 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "BVH.h"
+
+// Codigo Morton de 30 bits (10 por eje) de p en [0, 1]^3
+uint32_t morton3D(const Vec3& p);
+
+// BVH lineal (T. Karras, "Maximizing Parallelism in the Construction of BVHs, Octrees,
+// and k-d Trees", HPG 2012) construido en paralelo con OpenMP:
+//   1. codigo Morton de 30 bits del centro de cada objeto,
+//   2. ordenacion radix en paralelo,
+//   3. cada nodo interno se obtiene de forma independiente a partir de los codigos ordenados.
+// Usa los hilos que ya fija omp_set_num_threads. La jerarquia es peor que la SAH pero se
+// construye en una fraccion del tiempo; se recorre con BVH::intersect.
+class LBVH : public BVH {
+public:
+	void build(const std::vector<Object*>& ol);
+
+private:
+	int delta(const std::vector<uint32_t>& codes, int i, int j) const;
+	AABB fitBounds(int nodeIdx);
+};
@@ -2,20 +2,71 @@
 
 #include "Shape.h"
 #include "Material.h"
+#include "Sphere.h"
+#include "Diffuse.h"
+#include "Metallic.h"
+#include "Crystalline.h"
 
+// Las formas y materiales propios (Sphere, Diffuse, Metallic, Crystalline) se llaman con un
+// switch sobre su tipo, guardado al crear el objeto: llamada directa (o en linea) en vez de
+// virtual. Cualquier otra clase derivada de Shape o Material pasa por la llamada virtual.
 class Object {
 public:
-	Object(Shape* shape, Material* material) : s(shape), m(material) {}
+	Object(Shape* shape, Material* material) : s(shape), m(material), st(shape->type()), mt(material ? material->type() : -1) {}
 
-	bool checkCollision(const Ray& ray, float t_min, float t_max, CollisionData& cd) {
-		return (s->collide(ray, t_min, t_max, cd));
+	// Distancia del choque (ver Shape::hitDistance); punto y normal se piden despues con
+	// hitAttributes, solo para el choque mas cercano. hitAttributes devuelve el objeto cuyo
+	// material hay que usar: este, o el objeto cortado dentro de una instancia (que se vuelve
+	// a buscar desde el mismo t_min). Si esa busqueda lo pierde devuelve nullptr, como un fallo.
+	bool hitDistance(const Ray& ray, float t_min, float t_max, float& t) const {
+		if (st == SHAPE_SPHERE) return static_cast<const Sphere*>(s)->Sphere::hitDistance(ray, t_min, t_max, t);
+		return (s->hitDistance(ray, t_min, t_max, t));
+	}
+	Object* hitAttributes(const Ray& ray, float t_min, float t, CollisionData& cd) {
+		if (st == SHAPE_SPHERE) {
+			static_cast<const Sphere*>(s)->Sphere::hitAttributes(ray, t, cd);
+			return this;
+		}
+		Object* inner = s->innerHit(ray, t_min, cd);
+		if (inner || !m) return inner;	// sin material es una instancia
+		s->hitAttributes(ray, t, cd);
+		return this;
+	}
+
+	AABB boundingBox() const { return s->boundingBox(); }
+	bool bounded() const { return s->bounded(); }
+
+	bool scatter(const Ray& ray, const CollisionData& cd, Vec3& attenuation, Ray& scattered, Sampler* sampler) {
+		switch (mt) {
+		case MATERIAL_DIFFUSE: return static_cast<const Diffuse*>(m)->Diffuse::scatter(ray, cd, attenuation, scattered, sampler);
+		case MATERIAL_METALLIC: return static_cast<const Metallic*>(m)->Metallic::scatter(ray, cd, attenuation, scattered, sampler);
+		case MATERIAL_CRYSTALLINE: return static_cast<const Crystalline*>(m)->Crystalline::scatter(ray, cd, attenuation, scattered, sampler);
+		default: return (m->scatter(ray, cd, attenuation, scattered, sampler));
+		}
 	}
 
-	bool scatter(const Ray& ray, const CollisionData& cd, Vec3& attenuation, Ray& scattered) {
-		return (m->scatter(ray, cd, attenuation, scattered));
+	// Materiales con version por carriles (ScatterLanes.h): deja en u las uniformes que usaria
+	// scatter, sacadas del sampler, y devuelve true; false para los demas, sin tocar el sampler
+	bool scatterSamples(Sampler* sampler, float* u) const {
+		switch (mt) {
+		case MATERIAL_DIFFUSE: Diffuse::samples(sampler, u); return true;
+		case MATERIAL_METALLIC: Metallic::samples(sampler, u); return true;
+		case MATERIAL_CRYSTALLINE: Crystalline::samples(sampler, u); return true;
+		default: return false;
+		}
 	}
 
+	bool moving() const { return s->moving(); }
+	void setFrame(int frame) { s->setFrame(frame); }
+
+	const Shape* getShape() const { return s; }
+	int shapeType() const { return st; }
+	const Material* getMaterial() const { return m; }
+	int materialType() const { return mt; }
+
 private:
 	Shape* s;
 	Material* m;
+	int st;	// ShapeType de s
+	int mt;	// MaterialType de m (-1 sin material)
 };
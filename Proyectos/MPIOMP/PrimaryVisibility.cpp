@@ -0,0 +1,117 @@
+#include "PrimaryVisibility.h"
+
+#include <algorithm>
+#include <limits>
+
+void PrimaryVisibility::build(const Camera& cam, Scene& world, int w, int h, int px, int py, int pw, int ph) {
+	this->world = &world;
+	this->px = px;
+	this->py = py;
+	tilesX = (pw - px + TILE - 1) / TILE;
+	tilesY = (ph - py + TILE - 1) / TILE;
+	int numTiles = tilesX * tilesY;
+	objects.clear();
+	always = world.getUnbounded();
+
+	// un punto p se ve en el plano de enfoque, desde el punto l de la lente, en
+	// x = l + k (p - l) con k = lensDepth / (profundidad de p delante de la lente); k no depende
+	// de l, asi que los extremos salen de las esquinas de la lente
+	Vec3 llc = cam.getLowerLeftCorner();
+	Vec3 axis = cam.getW();
+	Vec3 invH = cam.getHorizontal() / cam.getHorizontal().squared_length();
+	Vec3 invV = cam.getVertical() / cam.getVertical().squared_length();
+	float lr = cam.getLensRadius();
+	Vec3 lens[4];
+	for (int l = 0; l < 4; l++) {
+		lens[l] = cam.getOrigin() + (l & 1 ? lr : -lr) * cam.getU() + (l & 2 ? lr : -lr) * cam.getV();
+	}
+	float lensDepth = dot(cam.getOrigin() - llc, axis);
+
+	// rectangulo de tiles de cada objeto (x0, y0, x1, y1), vacio si no cae en el patch
+	const std::vector<Object*>& ol = world.getObjects();
+	std::vector<int> rect(4 * ol.size());
+	std::vector<int> count(numTiles, 0);
+	for (size_t o = 0; o < ol.size(); o++) {
+		int* r = &rect[4 * o];
+		r[0] = 0; r[1] = 0; r[2] = -1; r[3] = -1;
+
+		AABB b = ol[o]->boundingBox();
+		float sMin = std::numeric_limits<float>::max(), tMin = sMin;
+		float sMax = -sMin, tMax = -sMin;
+		int behind = 0;
+		for (int c = 0; c < 8; c++) {
+			Vec3 p(c & 1 ? b.max.x() : b.min.x(), c & 2 ? b.max.y() : b.min.y(), c & 4 ? b.max.z() : b.min.z());
+			float depth = lensDepth - dot(p - llc, axis);
+			if (depth <= 1e-4f) {
+				behind++;
+				continue;
+			}
+			float k = lensDepth / depth;
+			for (int l = 0; l < 4; l++) {
+				Vec3 x = lens[l] - llc + k * (p - lens[l]);
+				float s = dot(x, invH);
+				float t = dot(x, invV);
+				sMin = std::min(sMin, s); sMax = std::max(sMax, s);
+				tMin = std::min(tMin, t); tMax = std::max(tMax, t);
+			}
+		}
+		if (behind == 8) continue;	// detras de la lente: ningun rayo primario lo alcanza
+		if (behind > 0) {
+			always.push_back(ol[o]);
+			continue;
+		}
+
+		// pixeles que puede cubrir, con uno de margen por el redondeo; se recorta al patch
+		// antes de pasar a entero
+		float i0 = std::max(sMin * w - 1.0f, float(px)), i1 = std::min(sMax * w + 1.0f, float(pw - 1));
+		float j0 = std::max(tMin * h - 1.0f, float(py)), j1 = std::min(tMax * h + 1.0f, float(ph - 1));
+		if (i0 > i1 || j0 > j1) continue;
+		r[0] = (int(i0) - px) / TILE;
+		r[1] = (int(j0) - py) / TILE;
+		r[2] = (int(i1) - px) / TILE;
+		r[3] = (int(j1) - py) / TILE;
+		for (int ty = r[1]; ty <= r[3]; ty++) {
+			for (int tx = r[0]; tx <= r[2]; tx++) count[ty * tilesX + tx]++;
+		}
+	}
+
+	useAccel.assign(numTiles, 0);
+	tileStart.assign(numTiles + 1, 0);
+	for (int t = 0; t < numTiles; t++) {
+		useAccel[t] = count[t] > MAX_CANDIDATES;
+		tileStart[t + 1] = tileStart[t] + (useAccel[t] ? 0 : count[t]);
+	}
+
+	// reparto en el orden de la escena
+	objects.resize(tileStart[numTiles]);
+	std::vector<int> fill(tileStart.begin(), tileStart.end() - 1);
+	for (size_t o = 0; o < ol.size(); o++) {
+		const int* r = &rect[4 * o];
+		for (int ty = r[1]; ty <= r[3]; ty++) {
+			for (int tx = r[0]; tx <= r[2]; tx++) {
+				int t = ty * tilesX + tx;
+				if (!useAccel[t]) objects[fill[t]++] = ol[o];
+			}
+		}
+	}
+}
+
+Object* PrimaryVisibility::closestHit(const Ray& r, int i, int j, CollisionData& cd) const {
+	int t = ((j - py) / TILE) * tilesX + (i - px) / TILE;
+	if (useAccel[t]) return world->closestHit(r, 0.001f, std::numeric_limits<float>::max(), cd);
+
+	Object* hit = nullptr;
+	float closest = std::numeric_limits<float>::max();
+	for (Object* o : always) {
+		if (o->hitDistance(r, 0.001f, closest, closest)) {
+			hit = o;
+		}
+	}
+	for (int k = tileStart[t]; k < tileStart[t + 1]; k++) {
+		if (objects[k]->hitDistance(r, 0.001f, closest, closest)) {
+			hit = objects[k];
+		}
+	}
+	if (hit) hit = hit->hitAttributes(r, 0.001f, closest, cd);
+	return hit;
+}
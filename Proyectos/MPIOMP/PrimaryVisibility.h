@@ -0,0 +1,33 @@
+#pragma once
+
+#include <vector>
+
+#include "Camera.h"
+#include "Scene.h"
+
+// Pre-paso de visibilidad primaria para el patch [px, pw) x [py, ph): la caja de cada objeto
+// se proyecta sobre el plano de enfoque con la base de la camara desde las esquinas de la
+// lente y su rectangulo en pantalla se reparte entre los tiles de TILE x TILE pixeles. Los
+// rayos primarios de un pixel solo prueban los candidatos de su tile. Los tiles con
+// demasiados candidatos usan la estructura de aceleracion de la escena.
+class PrimaryVisibility {
+public:
+	static const int TILE = 16;
+	static const int MAX_CANDIDATES = 8;
+
+	void build(const Camera& cam, Scene& world, int w, int h, int px, int py, int pw, int ph);
+
+	// Choque mas cercano del rayo primario del pixel (i, j), como Scene::closestHit
+	Object* closestHit(const Ray& r, int i, int j, CollisionData& cd) const;
+
+private:
+	Scene* world;
+	int px, py;
+	int tilesX, tilesY;
+
+	// candidatos del tile t: objects[tileStart[t]] .. objects[tileStart[t + 1] - 1]
+	std::vector<int> tileStart;
+	std::vector<char> useAccel;
+	std::vector<Object*> objects;
+	std::vector<Object*> always;	// infinitos o que cortan el plano de la lente: pueden verse en cualquier tile
+};
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <string>
+
+// Opciones de render opcionales. Se pasan como --nombre=valor detras de los
+// argumentos posicionales de cada version, en cualquier orden.
+struct RenderOptions {
+	std::string sampler = "random";	// --sampler=random|sobol|cmj
+	float adaptive = 0.0f;			// --adaptive=e: cada pixel muestrea hasta que el IC al 95% de su luminancia es < e * media (0 = ns fijo)
+	int adaptiveMax = 4;			// --adaptive-max=k: un pixel que no converge toma como mucho k * ns muestras
+	double progressive = 0.0;		// --progressive=s: render por pasadas hasta ns muestras o s segundos (0 = desactivado)
+	std::string accel = "auto";		// --accel=auto|bvh|lbvh|bvh4|bvh8|grid|simd|none: estructura de aceleracion de la escena
+	std::string stream = "off";		// --stream=off|unsorted|sorted: con sorted se ordena cada tanda de rebotes por tile
+	bool prepass = false;			// --prepass=0|1: pre-paso de visibilidad primaria por tiles
+	int packet = 0;					// --packet=4|8: rayos primarios en paquetes de 4x4 u 8x8 pixeles (0 = rayo a rayo)
+	bool groundPlane = false;		// --ground-plane=0|1: carga las esferas enormes de suelo como planos infinitos
+	bool sceneCache = true;			// --scene-cache=0|1: usa y guarda la cache binaria de la escena
+	int accelBench = 0;				// --accel-bench=n: mide la aceleracion frente al recorrido lineal con n x n rayos (0 = no)
+};
+
+RenderOptions parseRenderOptions(int argc, char** argv);
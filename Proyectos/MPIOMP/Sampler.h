@@ -0,0 +1,77 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include "random.h"
+
+// Genera las dimensiones de cada muestra de pixel. Por convencion las
+// dimensiones 0-1 son el desplazamiento dentro del pixel, 2-3 la lente de la
+// camara y a partir de ahi las que vayan pidiendo los materiales en cada rebote.
+class Sampler {
+public:
+	virtual ~Sampler() {}
+
+	// Situa el sampler en la muestra 'sample' del pixel (x, y), en la dimension 'dimension'
+	virtual void startPixelSample(int frame, int x, int y, int sample, int dimension = 0) = 0;
+
+	virtual float get1D() = 0;
+	virtual void get2D(float& u1, float& u2) = 0;
+
+	// Siguiente dimension que se va a consumir; con startPixelSample(..., getDimension())
+	// se retoma la muestra mas tarde en el mismo punto (trazado por tandas de rayos)
+	virtual int getDimension() const = 0;
+
+	// Dimensiones de camara (0-3) de las muestras [first, first + n) del pixel
+	void getCameraSamples(int frame, int x, int y, int first, int n, float* jx, float* jy, float* lx, float* ly);
+};
+
+// Uniformes independientes: la secuencia PCG de randomInitSample
+class RandomSampler : public Sampler {
+public:
+	void startPixelSample(int frame, int x, int y, int sample, int dimension = 0);
+	float get1D() { dimension++; return Mirandom(&local_rand_state); }
+	void get2D(float& u1, float& u2) { dimension += 2; u1 = Mirandom(&local_rand_state); u2 = Mirandom(&local_rand_state); }
+	int getDimension() const { return dimension; }
+
+protected:
+	int dimension;
+
+private:
+	RandomState local_rand_state;
+};
+
+// Jitter multiple correlado (A. Kensler, "Correlated Multi-Jittered Sampling",
+// Pixar 2013) para el desplazamiento dentro del pixel: las muestras del pixel quedan
+// estratificadas en la rejilla y en cada eje. El resto de dimensiones son las de RandomSampler.
+class CMJSampler : public RandomSampler {
+public:
+	CMJSampler(int samplesPerPixel) : n(samplesPerPixel) {}
+
+	void startPixelSample(int frame, int x, int y, int sample, int dimension = 0);
+	void get2D(float& u1, float& u2);
+
+private:
+	int n;
+	uint32_t pattern;
+	int sample;
+};
+
+// Sobol con scrambling de Owen por hash (B. Burley, "Practical Hash-based Owen
+// Scrambling", JCGT 2020). Cada par de dimensiones usa las dos primeras de Sobol
+// con su propio barajado de indices, asi hay tantas dimensiones como rebotes.
+class SobolSampler : public Sampler {
+public:
+	void startPixelSample(int frame, int x, int y, int sample, int dimension = 0);
+	float get1D();
+	void get2D(float& u1, float& u2);
+	int getDimension() const { return int(dimension); }
+
+private:
+	uint32_t pixelSeed;
+	uint32_t index;
+	uint32_t dimension;
+};
+
+// "random", "sobol" o "cmj"; devuelve nullptr si el nombre no es valido
+Sampler* createSampler(const std::string& name, int samplesPerPixel);
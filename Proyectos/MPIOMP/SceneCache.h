@@ -0,0 +1,19 @@
+#pragma once
+
+#include <string>
+
+#include "Scene.h"
+
+// Cache binaria de la escena y de su estructura de aceleracion, junto al fichero de escena
+// (<escena>.<accel>.cache). Lleva la version del formato y un hash del contenido del fichero
+// de escena: si alguno no coincide se ignora y se vuelve a construir. Los nodos del BVH se
+// usan directamente desde el fichero proyectado en memoria, sin copiarlos ni reconstruirlos.
+
+// true si habia una cache valida para ese fichero y esa estructura; world queda construida
+// variant distingue escenas cargadas con otras opciones del mismo fichero (<escena>.<accel>.<variant>.cache)
+bool loadSceneCache(const std::string& sceneFile, const std::string& accel, Scene& world, const std::string& variant = "");
+
+// Guarda una escena ya construida con build(accel). Se escribe en un temporal que despues se
+// renombra, asi otro proceso que este leyendo nunca ve un fichero a medias.
+// Las escenas con instancias no se guardan: se cargan siempre del fichero de escena.
+bool saveSceneCache(const std::string& sceneFile, const std::string& accel, const Scene& world, const std::string& variant = "");
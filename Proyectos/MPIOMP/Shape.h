@@ -2,8 +2,37 @@
 
 #include "Ray.h"
 #include "CollisionData.h"
+#include "AABB.h"
+#include "Arena.h"
+
+class Object;
+
+// tipo de forma guardado en la cache de escena (las instancias no se guardan)
+enum ShapeType { SHAPE_SPHERE = 0, SHAPE_PLANE = 1, SHAPE_INSTANCE = 2 };
 
 class Shape {
 public:
-	virtual bool collide(const Ray& ray, float t_min, float t_max, CollisionData& cd) const = 0;
+	virtual ~Shape() {}
+
+	// Busqueda del choque en dos pasos: hitDistance solo da la distancia t del choque mas
+	// cercano en (t_min, t_max) (t solo se escribe si hay choque, asi que puede ser la misma
+	// variable que t_max) y hitAttributes calcula punto y normal, solo para el choque definitivo
+	virtual bool hitDistance(const Ray& ray, float t_min, float t_max, float& t) const = 0;
+	virtual void hitAttributes(const Ray& ray, float t, CollisionData& cd) const = 0;
+	// Formas que agrupan otros objetos (instancias): como hitAttributes, y devuelve el objeto
+	// cortado, cuyo material es el que se usa (t_min es el de la busqueda que dio el choque),
+	// o nullptr si la nueva busqueda no lo encuentra. Las formas simples devuelven nullptr.
+	virtual Object* innerHit(const Ray& ray, float t_min, CollisionData& cd) const { return nullptr; }
+	virtual AABB boundingBox() const = 0;
+	// false para formas infinitas (planos), que no entran en las estructuras de aceleracion
+	virtual bool bounded() const { return true; }
+
+	// ShapeType y hasta 8 parametros que la describen (cache de escena)
+	virtual int type() const = 0;
+	virtual void params(float* p) const = 0;
+
+	// Movimiento entre fotogramas: setFrame coloca la forma donde esta en el fotograma frame.
+	// Por defecto las formas no se mueven.
+	virtual bool moving() const { return false; }
+	virtual void setFrame(int frame) {}
 };
@@ -7,14 +7,61 @@
 
 #include "Shape.h"
 
+// Choque de un rayo con la esfera de centro center y radio al cuadrado r2 (ver
+// Shape::hitDistance). La raiz y la division van en double. Es inline para que los bucles
+// que recorren esferas empaquetadas (PackedSphere) no pasen por la Shape.
+inline bool sphereHitDistance(const Vec3& center, float r2, const Ray& ray, float t_min, float t_max, float& t) {
+	Vec3 oc = ray.origin() - center;
+	float a = dot(ray.direction(), ray.direction());
+	float b = dot(oc, ray.direction());
+	float c = dot(oc, oc) - r2;
+	float discriminant = b * b - a * c;
+	if (discriminant > 0) {
+		float temp = float((-b - sqrt(double(discriminant))) / a);
+		if (temp < t_max && temp > t_min) {
+			t = temp;
+			return true;
+		}
+		temp = float((-b + sqrt(double(discriminant))) / a);
+		if (temp < t_max && temp > t_min) {
+			t = temp;
+			return true;
+		}
+	}
+	return false;
+}
+
 class Sphere : public Shape {
 public:
-	Sphere(): center(), radius() {}
-	Sphere(Vec3 center, float radius) : center(center), radius(radius) {}
+	Sphere(): center(), radius(), start(), velocity() {}
+	Sphere(Vec3 center, float radius, Vec3 velocity = Vec3(0, 0, 0)) : center(center), radius(radius), start(center), velocity(velocity) {}
+
+	// en el .h para que Object las pueda llamar sin pasar por la tabla virtual
+	bool hitDistance(const Ray& ray, float t_min, float t_max, float& t) const {
+		return sphereHitDistance(center, radius * radius, ray, t_min, t_max, t);
+	}
+	void hitAttributes(const Ray& ray, float t, CollisionData& cd) const {
+		cd.time = t;
+		cd.p = ray.point_at_parameter(t);
+		cd.normal = (cd.p - center) / radius;
+	}
+	AABB boundingBox() const;
+
+	int type() const { return SHAPE_SPHERE; }
+	void params(float* p) const {
+		p[0] = start.x(); p[1] = start.y(); p[2] = start.z(); p[3] = radius;
+		p[4] = velocity.x(); p[5] = velocity.y(); p[6] = velocity.z(); p[7] = 0.0f;
+	}
+
+	bool moving() const { return velocity.squared_length() > 0.0f; }
+	void setFrame(int frame) { center = start + float(frame) * velocity; }
 
-	bool collide(const Ray& ray, float t_min, float t_max, CollisionData& cd) const;
+	Vec3 getCenter() const { return center; }
+	float getRadius() const { return radius; }
 	
 private:
 	Vec3 center;
 	float radius;
+	Vec3 start;		// centro en el fotograma 0
+	Vec3 velocity;	// desplazamiento por fotograma
 };
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <vector>
+
+#include "Accelerator.h"
+
+// Sin estructura: el rayo se prueba contra todas las esferas, LANES a la vez (AVX; con SSE en
+// dos mitades), con centros y radios al cuadrado en SoA. Para escenas de pocas esferas sale
+// mas barato que bajar por un arbol (ver SIMD_MAX_SPHERES). Da los mismos choques que el
+// recorrido lineal: mismas operaciones por esfera que Sphere y, a igual distancia, gana la primera.
+// Las formas que no son esferas se prueban una a una despues. Las hojas de los BVH, los clusters
+// y el recorrido lineal prueban sus tiras de esferas de 4 en 4 con hitPackedRun (PackedSphere.h).
+class SphereSIMD : public Accelerator {
+public:
+	static const int LANES = 8;
+
+	void build(const std::vector<Object*>& ol);
+	Object* intersect(const Ray& r, float t_min, float t_max, float& t) const;
+	Object* intersectCounted(const Ray& r, float t_min, float t_max, float& t, NodeCache& cache) const;
+
+	// Basta con copiar los centros nuevos
+	bool refit(const std::vector<Object*>& ol, const std::vector<int>& moved);
+
+private:
+	void store(int k, Object* o);
+
+	// esfera k en cx[k], cy[k], cz[k], r2[k]; el relleno hasta un multiplo de LANES tiene
+	// r2 = -max y no lo corta ningun rayo
+	std::vector<float> cx, cy, cz, r2;
+	std::vector<Object*> spheres;
+	std::vector<Object*> others;
+	std::vector<int> slot;	// posicion en spheres de cada objeto de ol (-1 si va en others)
+};
@@ -0,0 +1,161 @@
+#include "UniformGrid.h"
+
+#include <cmath>
+
+static const float CELLS_PER_OBJECT = 2.0f;	// densidad de la rejilla (celdas por objeto)
+static const float LARGE_FACTOR = 64.0f;	// diagonal a partir de la cual un objeto va aparte
+static const int MAX_RES = 256;				// celdas por eje como mucho
+
+void UniformGrid::cellRange(const AABB& b, int lo[3], int hi[3]) const {
+	for (int a = 0; a < 3; a++) {
+		lo[a] = std::min(res[a] - 1, std::max(0, int((b.min[a] - bounds.min[a]) * invCellSize[a])));
+		hi[a] = std::min(res[a] - 1, std::max(0, int((b.max[a] - bounds.min[a]) * invCellSize[a])));
+	}
+}
+
+void UniformGrid::build(const std::vector<Object*>& ol) {
+	bounds = AABB();
+	cellStart.clear();
+	objects.clear();
+	large.clear();
+	res[0] = res[1] = res[2] = 1;
+	if (ol.empty()) return;
+
+	std::vector<AABB> boxes(ol.size());
+	std::vector<float> diag(ol.size());
+	for (size_t i = 0; i < ol.size(); i++) {
+		boxes[i] = ol[i]->boundingBox();
+		diag[i] = boxes[i].extent().length();
+	}
+	std::vector<float> sorted(diag);
+	std::nth_element(sorted.begin(), sorted.begin() + sorted.size() / 2, sorted.end());
+	float maxDiag = LARGE_FACTOR * sorted[sorted.size() / 2];
+
+	std::vector<int> inGrid;
+	for (size_t i = 0; i < ol.size(); i++) {
+		if (diag[i] > maxDiag) {
+			large.push_back(ol[i]);
+		}
+		else {
+			inGrid.push_back(int(i));
+			bounds.grow(boxes[i]);
+		}
+	}
+	if (inGrid.empty()) return;
+
+	// resolucion: unas CELLS_PER_OBJECT celdas por objeto, cubicas en lo posible
+	Vec3 ext = bounds.extent();
+	float minExt = 1e-3f * std::max(ext.x(), std::max(ext.y(), ext.z()));
+	float volume = 1.0f;
+	for (int a = 0; a < 3; a++) volume *= std::max(ext[a], minExt);
+	float cellsPerUnit = std::cbrt(CELLS_PER_OBJECT * inGrid.size() / volume);
+	for (int a = 0; a < 3; a++) {
+		res[a] = std::min(MAX_RES, std::max(1, int(ext[a] * cellsPerUnit)));
+		cellSize[a] = std::max(ext[a], minExt) / res[a];
+		invCellSize[a] = 1.0f / cellSize[a];
+	}
+
+	// dos pasadas: contar objetos por celda y despues colocarlos
+	int numCells = res[0] * res[1] * res[2];
+	cellStart.assign(numCells + 1, 0);
+	int lo[3], hi[3];
+	for (int i : inGrid) {
+		cellRange(boxes[i], lo, hi);
+		for (int z = lo[2]; z <= hi[2]; z++)
+			for (int y = lo[1]; y <= hi[1]; y++)
+				for (int x = lo[0]; x <= hi[0]; x++)
+					cellStart[cellIndex(x, y, z) + 1]++;
+	}
+	for (int c = 0; c < numCells; c++) {
+		cellStart[c + 1] += cellStart[c];
+	}
+	objects.resize(cellStart[numCells]);
+	std::vector<int> fill(cellStart.begin(), cellStart.end() - 1);
+	for (int i : inGrid) {
+		cellRange(boxes[i], lo, hi);
+		for (int z = lo[2]; z <= hi[2]; z++)
+			for (int y = lo[1]; y <= hi[1]; y++)
+				for (int x = lo[0]; x <= hi[0]; x++)
+					objects[fill[cellIndex(x, y, z)]++] = ol[i];
+	}
+	packSpheres(objects, spheres);
+}
+
+template <bool COUNT>
+Object* UniformGrid::traverse(const Ray& r, float t_min, float t_max, float& closest, NodeCache* cache) const {
+	Object* hit = nullptr;
+	closest = t_max;
+	for (Object* o : large) {
+		if (COUNT) cache->touch(o);
+		if (o->hitDistance(r, t_min, closest, closest)) {
+			hit = o;
+		}
+	}
+	if (cellStart.empty()) return hit;
+
+	Vec3 origin = r.origin();
+	Vec3 dir = r.direction();
+	Vec3 invDir(1.0f / dir.x(), 1.0f / dir.y(), 1.0f / dir.z());
+	float tEntry;
+	if (!bounds.hit(origin, invDir, t_min, closest, tEntry)) return hit;
+
+	// celda de entrada y distancias a los siguientes planos de cada eje
+	Vec3 p = origin + tEntry * dir;
+	int cell[3], step[3], out[3];
+	float tNext[3], tDelta[3];
+	for (int a = 0; a < 3; a++) {
+		cell[a] = std::min(res[a] - 1, std::max(0, int((p[a] - bounds.min[a]) * invCellSize[a])));
+		if (dir[a] > 0.0f) {
+			step[a] = 1;
+			out[a] = res[a];
+			tNext[a] = (bounds.min[a] + (cell[a] + 1) * cellSize[a] - origin[a]) * invDir[a];
+			tDelta[a] = cellSize[a] * invDir[a];
+		}
+		else if (dir[a] < 0.0f) {
+			step[a] = -1;
+			out[a] = -1;
+			tNext[a] = (bounds.min[a] + cell[a] * cellSize[a] - origin[a]) * invDir[a];
+			tDelta[a] = -cellSize[a] * invDir[a];
+		}
+		else {
+			step[a] = 0;
+			out[a] = -1;
+			tNext[a] = std::numeric_limits<float>::max();
+			tDelta[a] = 0.0f;
+		}
+	}
+
+	while (true) {
+		int c = cellIndex(cell[0], cell[1], cell[2]);
+		if (COUNT) cache->touchRange(&cellStart[c], 2 * sizeof(int));
+		for (int i = cellStart[c]; i < cellStart[c + 1]; i++) {
+			if (COUNT) {
+				cache->touch(&spheres[i]);
+				if (spheres[i].r2 < 0.0f) {
+					cache->touch(&objects[i]);
+					cache->touch(objects[i]);
+				}
+			}
+			if (hitPacked(spheres[i], objects[i], r, t_min, closest, closest)) {
+				hit = objects[i];
+			}
+		}
+
+		// siguiente celda por el eje cuyo plano esta mas cerca
+		int axis = (tNext[0] < tNext[1]) ? (tNext[0] < tNext[2] ? 0 : 2) : (tNext[1] < tNext[2] ? 1 : 2);
+		// un choque antes de salir de la celda ya no lo puede mejorar ninguna celda posterior
+		if (closest <= tNext[axis]) break;
+		cell[axis] += step[axis];
+		if (cell[axis] == out[axis]) break;
+		tNext[axis] += tDelta[axis];
+	}
+	return hit;
+}
+
+Object* UniformGrid::intersect(const Ray& r, float t_min, float t_max, float& t) const {
+	return traverse<false>(r, t_min, t_max, t, nullptr);
+}
+
+Object* UniformGrid::intersectCounted(const Ray& r, float t_min, float t_max, float& t, NodeCache& cache) const {
+	return traverse<true>(r, t_min, t_max, t, &cache);
+}
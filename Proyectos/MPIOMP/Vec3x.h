@@ -0,0 +1,126 @@
+#pragma once
+
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <immintrin.h>
+#define VEC3X_SSE
+#endif
+
+#include "Vec3.h"
+
+// Tipos de N carriles para la matematica de paquetes de rayos: FloatxN<N> son N floats y
+// Vec3xN<N> N vectores en SoA (x, y, z de los N seguidos). Las operaciones son las de float y
+// Vec3 aplicadas carril a carril, escritas como bucles de N fijo que el compilador vectoriza
+// (SSE con N = 4, AVX con N = 8). Cada carril hace las mismas operaciones en el mismo orden
+// que la version escalar, asi que da exactamente el mismo resultado (tests/Vec3xTest.cpp lo
+// comprueba). Con FMA (-march=native) el compilador puede fusionar productos y sumas de forma
+// distinta en cada version y la igualdad deja de ser exacta; -ffp-contract=off la recupera.
+// Las comparaciones devuelven una mascara de bits: el bit k es el carril k.
+
+template <int N>
+struct FloatxN {
+	float v[N];
+
+	FloatxN() {}
+	FloatxN(float s) { for (int k = 0; k < N; k++) v[k] = s; }
+
+	static FloatxN load(const float* p) { FloatxN r; for (int k = 0; k < N; k++) r.v[k] = p[k]; return r; }
+	void store(float* p) const { for (int k = 0; k < N; k++) p[k] = v[k]; }
+
+	float operator[](int k) const { return v[k]; }
+	float& operator[](int k) { return v[k]; }
+};
+
+template <int N> inline FloatxN<N> operator+(const FloatxN<N>& a, const FloatxN<N>& b) { FloatxN<N> r; for (int k = 0; k < N; k++) r.v[k] = a.v[k] + b.v[k]; return r; }
+template <int N> inline FloatxN<N> operator-(const FloatxN<N>& a, const FloatxN<N>& b) { FloatxN<N> r; for (int k = 0; k < N; k++) r.v[k] = a.v[k] - b.v[k]; return r; }
+template <int N> inline FloatxN<N> operator*(const FloatxN<N>& a, const FloatxN<N>& b) { FloatxN<N> r; for (int k = 0; k < N; k++) r.v[k] = a.v[k] * b.v[k]; return r; }
+template <int N> inline FloatxN<N> operator/(const FloatxN<N>& a, const FloatxN<N>& b) { FloatxN<N> r; for (int k = 0; k < N; k++) r.v[k] = a.v[k] / b.v[k]; return r; }
+template <int N> inline FloatxN<N> operator-(const FloatxN<N>& a) { FloatxN<N> r; for (int k = 0; k < N; k++) r.v[k] = -a.v[k]; return r; }
+
+// Raiz de float: la misma que sqrt(double) redondeada a float, como en el codigo escalar
+template <int N> inline FloatxN<N> sqrt(const FloatxN<N>& a) { FloatxN<N> r; for (int k = 0; k < N; k++) r.v[k] = std::sqrt(a.v[k]); return r; }
+
+template <int N> inline int operator<(const FloatxN<N>& a, const FloatxN<N>& b) { int m = 0; for (int k = 0; k < N; k++) m |= (a.v[k] < b.v[k]) << k; return m; }
+template <int N> inline int operator>(const FloatxN<N>& a, const FloatxN<N>& b) { return b < a; }
+
+// a en los carriles de mask y b en los demas
+template <int N> inline FloatxN<N> select(int mask, const FloatxN<N>& a, const FloatxN<N>& b) {
+	FloatxN<N> r;
+	for (int k = 0; k < N; k++) r.v[k] = (mask >> k) & 1 ? a.v[k] : b.v[k];
+	return r;
+}
+
+// Los bucles de bits de las mascaras de comparacion y de select no los vectoriza el compilador
+// a -O2, y en las pruebas de esferas de un solo rayo (hitPackedRun) cuestan mas que la propia
+// interseccion: con SSE van con intrinsecas (y la comparacion de 8 carriles con AVX), con el
+// mismo resultado.
+#ifdef VEC3X_SSE
+inline int operator<(const FloatxN<4>& a, const FloatxN<4>& b) { return _mm_movemask_ps(_mm_cmplt_ps(_mm_loadu_ps(a.v), _mm_loadu_ps(b.v))); }
+inline FloatxN<4> select(int mask, const FloatxN<4>& a, const FloatxN<4>& b) {
+	__m128i bits = _mm_set_epi32(8, 4, 2, 1);
+	__m128 m = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(_mm_set1_epi32(mask), bits), bits));
+	FloatxN<4> r;
+	_mm_storeu_ps(r.v, _mm_or_ps(_mm_and_ps(m, _mm_loadu_ps(a.v)), _mm_andnot_ps(m, _mm_loadu_ps(b.v))));
+	return r;
+}
+#endif
+#ifdef __AVX__
+inline int operator<(const FloatxN<8>& a, const FloatxN<8>& b) { return _mm256_movemask_ps(_mm256_cmp_ps(_mm256_loadu_ps(a.v), _mm256_loadu_ps(b.v), _CMP_LT_OQ)); }
+#endif
+
+template <int N>
+struct Vec3xN {
+	FloatxN<N> x, y, z;
+
+	Vec3xN() {}
+	Vec3xN(const FloatxN<N>& x, const FloatxN<N>& y, const FloatxN<N>& z) : x(x), y(y), z(z) {}
+	// el mismo vector en todos los carriles
+	Vec3xN(const Vec3& v) : x(v.x()), y(v.y()), z(v.z()) {}
+
+	void set(int k, const Vec3& v) { x[k] = v.x(); y[k] = v.y(); z[k] = v.z(); }
+	Vec3 get(int k) const { return Vec3(x[k], y[k], z[k]); }
+
+	FloatxN<N> length() const { return sqrt(x * x + y * y + z * z); }
+	FloatxN<N> squared_length() const { return x * x + y * y + z * z; }
+};
+
+template <int N> inline Vec3xN<N> operator+(const Vec3xN<N>& a, const Vec3xN<N>& b) { return Vec3xN<N>(a.x + b.x, a.y + b.y, a.z + b.z); }
+template <int N> inline Vec3xN<N> operator-(const Vec3xN<N>& a, const Vec3xN<N>& b) { return Vec3xN<N>(a.x - b.x, a.y - b.y, a.z - b.z); }
+template <int N> inline Vec3xN<N> operator*(const Vec3xN<N>& a, const Vec3xN<N>& b) { return Vec3xN<N>(a.x * b.x, a.y * b.y, a.z * b.z); }
+template <int N> inline Vec3xN<N> operator-(const Vec3xN<N>& a) { return Vec3xN<N>(-a.x, -a.y, -a.z); }
+template <int N> inline Vec3xN<N> operator*(const FloatxN<N>& t, const Vec3xN<N>& a) { return Vec3xN<N>(a.x * t, a.y * t, a.z * t); }
+template <int N> inline Vec3xN<N> operator*(const Vec3xN<N>& a, const FloatxN<N>& t) { return Vec3xN<N>(a.x * t, a.y * t, a.z * t); }
+// como Vec3: se multiplica por el inverso
+template <int N> inline Vec3xN<N> operator/(const Vec3xN<N>& a, const FloatxN<N>& t) { FloatxN<N> k = FloatxN<N>(1.0f) / t; return a * k; }
+
+template <int N> inline FloatxN<N> dot(const Vec3xN<N>& a, const Vec3xN<N>& b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+
+template <int N> inline Vec3xN<N> cross(const Vec3xN<N>& a, const Vec3xN<N>& b) {
+	return Vec3xN<N>(a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x);
+}
+
+template <int N> inline Vec3xN<N> unit_vector(const Vec3xN<N>& v) { return v / v.length(); }
+
+// reflect y refract de utils.h
+template <int N> inline Vec3xN<N> reflect(const Vec3xN<N>& v, const Vec3xN<N>& n) {
+	return v - FloatxN<N>(2.0f) * dot(v, n) * n;
+}
+
+// Devuelve la mascara de los carriles que refractan; en los demas refracted no cambia
+template <int N> inline int refract(const Vec3xN<N>& v, const Vec3xN<N>& n, const FloatxN<N>& ni_over_nt, Vec3xN<N>& refracted) {
+	Vec3xN<N> uv = unit_vector(v);
+	FloatxN<N> dt = dot(uv, n);
+	FloatxN<N> discriminant = FloatxN<N>(1.0f) - ni_over_nt * ni_over_nt * (FloatxN<N>(1.0f) - dt * dt);
+	int mask = discriminant > FloatxN<N>(0.0f);
+	if (mask) {
+		Vec3xN<N> r = ni_over_nt * (uv - n * dt) - n * sqrt(select(mask, discriminant, FloatxN<N>(0.0f)));
+		refracted = Vec3xN<N>(select(mask, r.x, refracted.x), select(mask, r.y, refracted.y), select(mask, r.z, refracted.z));
+	}
+	return mask;
+}
+
+typedef FloatxN<4> Floatx4;
+typedef FloatxN<8> Floatx8;
+typedef Vec3xN<4> Vec3x4;
+typedef Vec3xN<8> Vec3x8;
@@ -16,6 +16,7 @@
 #include <limits>
 #include <sstream>
 #include <fstream>
+#include <map>
 #include <algorithm>
 #include <cmath>
 #include <vector>
@@ -27,22 +28,107 @@
 #include "Object.h"
 #include "Scene.h"
 #include "Sphere.h"
+#include "Plane.h"
+#include "Instance.h"
 #include "Diffuse.h"
 #include "Metallic.h"
 #include "Crystalline.h"
 
 #include "random.h"
 #include "utils.h"
+#include "Sampler.h"
+#include "RenderOptions.h"
+#include "SceneCache.h"
+#include "LBVH.h"
+#include "PrimaryVisibility.h"
+#include "ScatterLanes.h"
 
 struct Patch {
 	int px, py, pw, ph;
 };
 
-Scene loadObjectsFromFile(const std::string& filename) {
+// Esferas quietas de radio mayor que este que pueden hacer de suelo: con groundPlanes se
+// cambian por el plano horizontal tangente a su punto mas alto, pero solo si quedan por debajo
+// de la escena (ver loadObjectsFromFile). Se supone que el suelo es horizontal: una esfera
+// enorme que haga de pared o de fondo se queda como esfera.
+static const float GROUND_SPHERE_RADIUS = 100.0f;
+
+// Esfera candidata a suelo, que se decide al terminar de leer el fichero
+struct GroundSphere {
+	Vec3 center;
+	float radius;
+	Material* material;
+};
+
+// Anade el objeto a la escena o, si se esta leyendo un cluster, al cluster. lowest baja hasta
+// la parte mas baja de los objetos con caja de la escena.
+static void addObject(Scene& list, Cluster* cluster, Object* o, const std::string& line, float& lowest) {
+	if (!cluster) {
+		list.add(o);
+		if (o->bounded()) lowest = std::min(lowest, o->boundingBox().min.y());
+	}
+	else if (!cluster->add(o)) std::cerr << "Error: Objeto infinito o en movimiento dentro de un cluster en la linea: " << line << std::endl;
+}
+
+// Material escrito desde tokens[first]: "Diffuse ( (r, g, b) )", "Metallic ( (r, g, b), fuzz )"
+// o "Crystalline ( indice )". Devuelve su indice en la tabla de materiales de la escena (donde
+// los iguales se juntan en uno), o -1 si el formato no es correcto
+static int parseMaterial(const std::vector<std::string>& tokens, size_t first, Scene& list) {
+	size_t n = tokens.size() - first;
+	if (n < 4 || tokens[first + 1] != "(") return -1;
+	const std::string* t = &tokens[first + 2];
+	float p[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+	if (tokens[first] == "Crystalline" && t[1].back() == ')') {
+		p[0] = std::stof(t[0]);
+		return list.addMaterial(MATERIAL_CRYSTALLINE, p);
+	}
+	bool metallic = tokens[first] == "Metallic" && n == 7 && t[4] == ")";
+	bool diffuse = tokens[first] == "Diffuse" && n == 6 && t[3].back() == ')';
+	if (!metallic && !diffuse) return -1;
+	p[0] = std::stof(t[0].substr(t[0].find('(') + 1, t[0].find(',') - t[0].find('(') - 1));
+	p[1] = std::stof(t[1].substr(0, t[1].find(',')));
+	p[2] = std::stof(t[2].substr(0, t[2].find(',')));
+	if (diffuse) return list.addMaterial(MATERIAL_DIFFUSE, p);
+	p[3] = std::stof(t[3].substr(0, t[3].length() - 1));
+	return list.addMaterial(MATERIAL_METALLIC, p);
+}
+
+// Materiales de randomScene, tambien en la tabla de la escena
+static Material* diffuse(Scene& list, const Vec3& color) {
+	float p[4] = { color.x(), color.y(), color.z(), 0.0f };
+	return list.getMaterial(list.addMaterial(MATERIAL_DIFFUSE, p));
+}
+static Material* metallic(Scene& list, const Vec3& albedo, float fuzz) {
+	float p[4] = { albedo.x(), albedo.y(), albedo.z(), fuzz };
+	return list.getMaterial(list.addMaterial(MATERIAL_METALLIC, p));
+}
+static Material* crystalline(Scene& list, float ri) {
+	float p[4] = { ri, 0.0f, 0.0f, 0.0f };
+	return list.getMaterial(list.addMaterial(MATERIAL_CRYSTALLINE, p));
+}
+
+// Lineas "Object Sphere ( (x, y, z), r ) <material>" y "Object Plane ( (nx, ny, nz), d ) <material>".
+// Los objetos entre "Cluster <nombre>" y "EndCluster" forman un grupo que no se anade a la
+// escena; cada "Instance <nombre> ( (x, y, z), escala, angulo )" pone una copia del grupo
+// trasladada, escalada (escala > 0) y girada (grados) alrededor del eje Y. Solo se guarda una vez la geometria.
+// "Material <material>" anade un material a la tabla del fichero; un objeto puede llevar su
+// material escrito o "Material k", el k-esimo de la tabla (desde 0). Los materiales iguales,
+// escritos de una forma u otra, se crean una sola vez y los comparten los objetos.
+// Con groundPlanes, una esfera quieta de radio mayor que GROUND_SPHERE_RADIUS fuera de los
+// clusters se cambia por un plano horizontal si hace de suelo: su punto mas alto no pasa de la
+// parte mas baja de los demas objetos, o su centro queda por debajo de todos ellos. Si no, se
+// queda como esfera (un fondo o un techo enorme), anadida al final de la escena.
+Scene loadObjectsFromFile(const std::string& filename, bool groundPlanes = false) {
 	std::ifstream file(filename);
 	std::string line;
 
 	Scene list;
+	Arena& arena = list.getArena();
+	std::map<std::string, Cluster*> clusters;
+	Cluster* cluster = nullptr;	// grupo que se esta leyendo
+	std::vector<int> fileMaterials;	// lineas Material, por orden: indice en la tabla de la escena (-1 si no era valido)
+	std::vector<GroundSphere> grounds;	// esferas que pueden ser suelo (solo con groundPlanes)
+	float lowest = std::numeric_limits<float>::max();	// parte mas baja de los demas objetos
 
 	if (file.is_open()) {
 		while (std::getline(file, line)) {
@@ -56,48 +142,114 @@ Scene loadObjectsFromFile(const std::string& filename) {
 
 			if (tokens.empty()) continue;
 
+			if (tokens[0] == "Cluster" && tokens.size() == 2) {
+				cluster = new Cluster();
+				clusters[tokens[1]] = cluster;
+				list.addCluster(cluster);
+				continue;
+			}
+			if (tokens[0] == "EndCluster") {
+				cluster = nullptr;
+				continue;
+			}
+			if (tokens[0] == "Instance" && tokens.size() == 9 && tokens[2] == "(" && tokens[8] == ")") {
+				auto c = clusters.find(tokens[1]);
+				if (c == clusters.end() || c->second == cluster || c->second->size() == 0) {
+					std::cerr << "Error: Cluster desconocido o vacio en la linea: " << line << std::endl;
+					continue;
+				}
+				try {
+					float ix = std::stof(tokens[3].substr(tokens[3].find('(') + 1, tokens[3].find(',') - tokens[3].find('(') - 1));
+					float iy = std::stof(tokens[4].substr(0, tokens[4].find(',')));
+					float iz = std::stof(tokens[5].substr(0, tokens[5].find(')')));
+					float is = std::stof(tokens[6].substr(0, tokens[6].find(',')));
+					float ia = std::stof(tokens[7]);
+					// con escala nula el rayo local sale NaN y con una negativa la copia queda
+					// reflejada, con las normales hacia dentro
+					if (!(is > 0.0f)) {
+						std::cerr << "Error: Instancia incorrecta en la linea: " << line << " - la escala debe ser positiva" << std::endl;
+						continue;
+					}
+					addObject(list, cluster, arena.make<Object>(arena.make<Instance>(c->second, Vec3(ix, iy, iz), is, ia), nullptr), line, lowest);
+				}
+				catch (const std::invalid_argument& e) {
+					std::cerr << "Error: Instancia incorrecta en la linea: " << line << " - " << e.what() << std::endl;
+				}
+				catch (const std::out_of_range& e) {
+					std::cerr << "Error: Instancia fuera de rango en la linea: " << line << " - " << e.what() << std::endl;
+				}
+				continue;
+			}
+
+			if (tokens[0] == "Material") {
+				int mat = -1;
+				try {
+					mat = parseMaterial(tokens, 1, list);
+					if (mat < 0) std::cerr << "Error: Material desconocido o formato incorrecto en la linea: " << line << std::endl;
+				}
+				catch (const std::invalid_argument& e) {
+					std::cerr << "Error: Material incorrecto en la linea: " << line << " - " << e.what() << std::endl;
+				}
+				catch (const std::out_of_range& e) {
+					std::cerr << "Error: Material fuera de rango en la linea: " << line << " - " << e.what() << std::endl;
+				}
+				fileMaterials.push_back(mat);
+				continue;
+			}
+
+			// Velocidad opcional al final de la linea: Velocity ( (vx, vy, vz) ), desplazamiento
+			// del centro de la esfera por fotograma
+			Vec3 velocity(0, 0, 0);
+			if (tokens.size() >= 6 && tokens[tokens.size() - 6] == "Velocity") {
+				size_t v = tokens.size() - 6;
+				try {
+					float vx = std::stof(tokens[v + 2].substr(tokens[v + 2].find('(') + 1, tokens[v + 2].find(',') - tokens[v + 2].find('(') - 1));
+					float vy = std::stof(tokens[v + 3].substr(0, tokens[v + 3].find(',')));
+					float vz = std::stof(tokens[v + 4].substr(0, tokens[v + 4].find(')')));
+					velocity = Vec3(vx, vy, vz);
+				}
+				catch (const std::invalid_argument& e) {
+					std::cerr << "Error: Velocidad incorrecta en la linea: " << line << " - " << e.what() << std::endl;
+				}
+				catch (const std::out_of_range& e) {
+					std::cerr << "Error: Velocidad fuera de rango en la linea: " << line << " - " << e.what() << std::endl;
+				}
+				tokens.resize(v);
+			}
+
 			// Esperamos al menos la palabra clave "Object"
-			if (tokens[0] == "Object" && tokens.size() >= 12) { // M�nimo para Sphere y un material con 1 float
+			if (tokens[0] == "Object" && tokens.size() >= 10) { // M�nimo para Sphere y "Material k"
 				// Parsear la esfera
-				if (tokens[1] == "Sphere" && tokens[2] == "(" && tokens[7] == ")") {
+				if ((tokens[1] == "Sphere" || tokens[1] == "Plane") && tokens[2] == "(" && tokens[7] == ")") {
 					try {
 						float sx = std::stof(tokens[3].substr(tokens[3].find('(') + 1, tokens[3].find(',') - tokens[3].find('(') - 1));
 						float sy = std::stof(tokens[4].substr(0, tokens[4].find(',')));
 						float sz = std::stof(tokens[5].substr(0, tokens[5].find(',')));
 						float sr = std::stof(tokens[6]);
 
+						bool ground = groundPlanes && !cluster && tokens[1] == "Sphere" && sr > GROUND_SPHERE_RADIUS && velocity.squared_length() == 0.0f;
+						Shape* shape = nullptr;
+						if (tokens[1] == "Plane") shape = arena.make<Plane>(Vec3(sx, sy, sz), sr);
+						else if (!ground) shape = arena.make<Sphere>(Vec3(sx, sy, sz), sr, velocity);
+
 						// Parsear el material del �ltimo objeto creado
 
-						if (tokens[8] == "Crystalline" && tokens[9] == "(" && tokens[11].back() == ')') {
-							float ma = std::stof(tokens[10]);
-							list.add(new Object(
-								new Sphere(Vec3(sx, sy, sz), sr),
-								new Crystalline(ma)
-							));
-							//std::cout << "Crystaline" << sx << " " << sy << " " << sz << " " << sr << " " << ma << "\n";
+						int mat = -1;
+						if (tokens[8] == "Material" && tokens.size() == 10) {
+							size_t k = std::stoul(tokens[9]);
+							if (k < fileMaterials.size()) mat = fileMaterials[k];
 						}
-						else if (tokens[8] == "Metallic" && tokens.size() == 15 && tokens[9] == "(" && tokens[14] == ")") {
-							float ma = std::stof(tokens[10].substr(tokens[10].find('(') + 1, tokens[10].find(',') - tokens[10].find('(') - 1));
-							float mb = std::stof(tokens[11].substr(0, tokens[11].find(',')));
-							float mc = std::stof(tokens[12].substr(0, tokens[12].find(',')));
-							float mf = std::stof(tokens[13].substr(0, tokens[13].length() - 1));
-							list.add(new Object(
-								new Sphere(Vec3(sx, sy, sz), sr),
-								new Metallic(Vec3(ma, mb, mc), mf)
-							));
-							//std::cout << "Metallic" << sx << " " << sy << " " << sz << " " << sr << " " << ma << " " << mb << " " << mc << " " << mf << "\n";
+						else mat = parseMaterial(tokens, 8, list);
+
+						if (mat >= 0 && ground) {
+							GroundSphere g = { Vec3(sx, sy, sz), sr, list.getMaterial(mat) };
+							grounds.push_back(g);
 						}
-						else if (tokens[8] == "Diffuse" && tokens.size() == 14 && tokens[9] == "(" && tokens[13].back() == ')') {
-							float ma = std::stof(tokens[10].substr(tokens[10].find('(') + 1, tokens[10].find(',') - tokens[10].find('(') - 1));
-							float mb = std::stof(tokens[11].substr(0, tokens[11].find(',')));
-							float mc = std::stof(tokens[12].substr(0, tokens[12].find(',')));
-							list.add(new Object(
-								new Sphere(Vec3(sx, sy, sz), sr),
-								new Diffuse(Vec3(ma, mb, mc))
-							));
-							//std::cout << "Diffuse" << sx << " " << sy << " " << sz << " " << sr << " " << ma << " " << mb << " " << mc << "\n";
+						else if (mat >= 0) {
+							addObject(list, cluster, arena.make<Object>(shape, list.getMaterial(mat)), line, lowest);
 						}
 						else {
+							// la forma queda en la arena hasta que se libera la escena
 							std::cerr << "Error: Material desconocido o formato incorrecto en la linea: " << line << std::endl;
 						}
 					}
@@ -121,137 +273,593 @@ Scene loadObjectsFromFile(const std::string& filename) {
 	else {
 		std::cerr << "Error: No se pudo abrir el archivo: " << filename << std::endl;
 	}
+	for (const GroundSphere& g : grounds) {
+		Shape* shape;
+		float top = g.center.y() + g.radius;
+		if (top <= lowest || g.center.y() < lowest) shape = arena.make<Plane>(Vec3(0, 1, 0), top);
+		else shape = arena.make<Sphere>(g.center, g.radius);
+		list.add(arena.make<Object>(shape, g.material));
+	}
 	return list;
 }
 
 Scene randomScene() {
 	int n = 500;
 	Scene list;
-	list.add(new Object(
-		new Sphere(Vec3(0, -1000, 0), 1000),
-		new Diffuse(Vec3(0.5, 0.5, 0.5))
+	Arena& arena = list.getArena();
+	RandomState local_rand_state;
+	randomInit(1984, 0, &local_rand_state);
+	list.add(arena.make<Object>(
+		arena.make<Sphere>(Vec3(0, -1000, 0), 1000),
+		diffuse(list, Vec3(0.5, 0.5, 0.5))
 	));
 
 	for (int a = -11; a < 11; a++) {
 		for (int b = -11; b < 11; b++) {
-			float choose_mat = Mirandom();
-			Vec3 center(a + 0.9f * Mirandom(), 0.2f, b + 0.9f * Mirandom());
+			float choose_mat = Mirandom(&local_rand_state);
+			Vec3 center(a + 0.9f * Mirandom(&local_rand_state), 0.2f, b + 0.9f * Mirandom(&local_rand_state));
 			if ((center - Vec3(4, 0.2f, 0)).length() > 0.9f) {
 				if (choose_mat < 0.8f) {  // diffuse
-					list.add(new Object(
-						new Sphere(center, 0.2f),
-						new Diffuse(Vec3(Mirandom() * Mirandom(),
-							Mirandom() * Mirandom(),
-							Mirandom() * Mirandom()))
+					list.add(arena.make<Object>(
+						arena.make<Sphere>(center, 0.2f),
+						diffuse(list, Vec3(Mirandom(&local_rand_state) * Mirandom(&local_rand_state),
+							Mirandom(&local_rand_state) * Mirandom(&local_rand_state),
+							Mirandom(&local_rand_state) * Mirandom(&local_rand_state)))
 					));
 				}
 				else if (choose_mat < 0.95f) { // metal
-					list.add(new Object(
-						new Sphere(center, 0.2f),
-						new Metallic(Vec3(0.5f * (1 + Mirandom()),
-							0.5f * (1 + Mirandom()),
-							0.5f * (1 + Mirandom())),
-							0.5f * Mirandom())
+					list.add(arena.make<Object>(
+						arena.make<Sphere>(center, 0.2f),
+						metallic(list, Vec3(0.5f * (1 + Mirandom(&local_rand_state)),
+							0.5f * (1 + Mirandom(&local_rand_state)),
+							0.5f * (1 + Mirandom(&local_rand_state))),
+							0.5f * Mirandom(&local_rand_state))
 					));
 				}
 				else {  // glass
-					list.add(new Object(
-						new Sphere(center, 0.2f),
-						new Crystalline(1.5f)
+					list.add(arena.make<Object>(
+						arena.make<Sphere>(center, 0.2f),
+						crystalline(list, 1.5f)
 					));
 				}
 			}
 		}
 	}
 
-	list.add(new Object(
-		new Sphere(Vec3(0, 1, 0), 1.0),
-		new Crystalline(1.5f)
+	list.add(arena.make<Object>(
+		arena.make<Sphere>(Vec3(0, 1, 0), 1.0),
+		crystalline(list, 1.5f)
 	));
-	list.add(new Object(
-		new Sphere(Vec3(-4, 1, 0), 1.0f),
-		new Diffuse(Vec3(0.4f, 0.2f, 0.1f))
+	list.add(arena.make<Object>(
+		arena.make<Sphere>(Vec3(-4, 1, 0), 1.0f),
+		diffuse(list, Vec3(0.4f, 0.2f, 0.1f))
 	));
-	list.add(new Object(
-		new Sphere(Vec3(4, 1, 0), 1.0f),
-		new Metallic(Vec3(0.7f, 0.6f, 0.5f), 0.0f)
+	list.add(arena.make<Object>(
+		arena.make<Sphere>(Vec3(4, 1, 0), 1.0f),
+		metallic(list, Vec3(0.7f, 0.6f, 0.5f), 0.0f)
 	));
 
 	return list;
 }
 
-void rayTracingCPULocalCoord(unsigned char* img, int w, int h, int ns = 10, int px = 0, int py = 0, int pw = -1, int ph = -1) {
-	if (pw == -1) pw = w;
-	if (ph == -1) ph = h;
+// Contadores de --stream=sorted: fallos de la cache simulada al trazar los rebotes en el orden
+// de generacion y tras ordenarlos, medidos en una de cada STREAM_CHECK tandas. Si la escena cabe
+// en los 32 KB de NodeCache solo hay fallos obligatorios y la razon sale 1 con cualquier orden: las
+// 488 esferas de randomScene() son unos 13 KB entre nodos del BVH y esferas. En una nube de 200000
+// esferas sale 1.04 con ns = 4 y 1.16 con ns = 64 (BVH): cuantos mas rebotes por tanda
+// (STREAM_TILE^2 * ns), mas vecinos comparten nodos tras ordenarlos.
+struct StreamStats {
+	long long missesUnsorted = 0;
+	long long missesSorted = 0;
+};
+
+static const int STREAM_TILE = 16;
+static const int STREAM_CHECK = 8;
+
+// Camino en curso del trazado por tandas. dimension: por donde retomar el sampler; slot: donde se
+// suma su color.
+struct PathState {
+	Ray ray;
+	Vec3 throughput;
+	int x, y, sample, dimension, slot;
+};
+
+// Camino de la muestra s del pixel (i, j), con su jitter (jx, jy) y su punto de la lente (lx, ly)
+// ya llevado al disco
+static PathState cameraPath(Camera& cam, int i, int j, int w, int h, int s, float jx, float jy, float lx, float ly, int slot) {
+	PathState p;
+	p.ray = cam.get_ray(float(i + jx) / float(w), float(j + jy) / float(h), Vec3(lx, ly, 0));
+	p.throughput = Vec3(1, 1, 1);
+	p.x = i;
+	p.y = j;
+	p.sample = s;
+	p.dimension = 4; // los rebotes siguen tras las dimensiones de camara
+	p.slot = slot;
+	return p;
+}
+
+// Clave de orden: octante de la direccion en los bits altos y codigo Morton del origen
+// dentro de la caja de los origenes de la tanda en los bajos
+uint64_t rayKey(const Ray& r, const AABB& box, const Vec3& scale) {
+	Vec3 d = r.direction();
+	uint64_t octant = (d.x() < 0.0f ? 4 : 0) | (d.y() < 0.0f ? 2 : 0) | (d.z() < 0.0f ? 1 : 0);
+	return (octant << 30) | morton3D((r.origin() - box.min) * scale);
+}
+
+// Lleva los caminos de paths rebote a rebote hasta que terminan y suma en color[slot] lo que
+// aporta cada uno (el fondo por su atenuacion). Cada tanda de rebotes avanza junta: primero los
+// choques y las uniformes de cada rebote, con el sampler en su camino, y despues scatterLanes,
+// de 8 en 8 por tipo de material (ScatterLanes.h). El primer choque sale de prepass si lo hay.
+// Con sorted, antes de trazar cada tanda de rebotes se ordena por celda del origen y octante de
+// la direccion para que rayos vecinos recorran los mismos nodos seguidos; en stats se cuentan
+// los fallos de cache de una de cada STREAM_CHECK tandas (wave numera las tandas). Vacia paths.
+static void traceWaves(Scene& world, Sampler* sampler, int frame, std::vector<PathState>& paths, Vec3* color,
+	const PrimaryVisibility* prepass, bool sorted, int& wave, StreamStats& stats) {
+	// se reutilizan entre llamadas del mismo hilo
+	static thread_local std::vector<PathState> next, bounced;
+	static thread_local std::vector<ScatterItem> items;
+	static thread_local std::vector<std::pair<uint64_t, int> > keys;
+
+	for (int depth = 0; !paths.empty(); depth++) {
+		bool check = false;
+		NodeCache cache;
+		if (depth > 0 && sorted) {
+			check = (wave++ % STREAM_CHECK) == 0;
+			if (check) {
+				NodeCache unsorted;
+				CollisionData cd;
+				for (const PathState& p : paths) world.closestHitCounted(p.ray, cd, unsorted);
+				stats.missesUnsorted += unsorted.misses;
+			}
+
+			AABB box;
+			for (const PathState& p : paths) box.grow(p.ray.origin());
+			Vec3 ext = box.extent();
+			Vec3 scale(ext.x() > 0.0f ? 1.0f / ext.x() : 0.0f, ext.y() > 0.0f ? 1.0f / ext.y() : 0.0f, ext.z() > 0.0f ? 1.0f / ext.z() : 0.0f);
+			keys.resize(paths.size());
+			for (size_t k = 0; k < paths.size(); k++) {
+				keys[k] = std::make_pair(rayKey(paths[k].ray, box, scale), int(k));
+			}
+			std::sort(keys.begin(), keys.end());
+			next.resize(paths.size());
+			for (size_t k = 0; k < keys.size(); k++) {
+				next[k] = paths[keys[k].second];
+			}
+			paths.swap(next);
+		}
+
+		items.clear();
+		bounced.clear();
+		for (const PathState& p : paths) {
+			items.emplace_back();
+			ScatterItem& it = items.back();
+			it.ray = p.ray;
+			if (depth == 0 && prepass) it.hit = prepass->closestHit(p.ray, p.x, p.y, it.cd);
+			else if (check) it.hit = world.closestHitCounted(p.ray, it.cd, cache);
+			else it.hit = world.closestHit(p.ray, 0.001f, std::numeric_limits<float>::max(), it.cd);
+			if (!it.hit || depth >= world.getMaxDepth()) {
+				if (!it.hit) color[p.slot] += p.throughput * world.getBackground(p.ray);
+				items.pop_back();
+				continue;
+			}
+
+			sampler->startPixelSample(frame, p.x, p.y, p.sample, p.dimension);
+			it.lanes = it.hit->scatterSamples(sampler, it.u);
+			if (!it.lanes) it.alive = it.hit->scatter(p.ray, it.cd, it.attenuation, it.scattered, sampler);
+			bounced.push_back(p);
+			bounced.back().dimension = sampler->getDimension();
+		}
+		if (check) stats.missesSorted += cache.misses;
+
+		scatterLanes(items);
+		next.clear();
+		for (size_t k = 0; k < items.size(); k++) {
+			if (!items[k].alive) continue;
+			PathState& q = bounced[k];
+			q.ray = items[k].scattered;
+			q.throughput = q.throughput * items[k].attenuation;
+			next.push_back(q);
+		}
+		paths.swap(next);
+	}
+}
+
+// Anade a paths los caminos de las muestras [first, first + n) del pixel (i, j), con su color en
+// color[slot], color[slot + 1]... buf ha de tener sitio para 4 * n floats (jitter y lente de cada muestra).
+static void pixelPaths(Camera& cam, Sampler* sampler, int i, int j, int w, int h, int first, int n, int frame,
+	std::vector<float>& buf, int slot, std::vector<PathState>& paths) {
+	float* jx = buf.data();
+	float* jy = jx + n;
+	float* lx = jy + n;
+	float* ly = lx + n;
+	sampler->getCameraSamples(frame, i, j, first, n, jx, jy, lx, ly);
+	sampleDisk(n, lx, ly);
+	for (int s = 0; s < n; s++) {
+		paths.push_back(cameraPath(cam, i, j, w, h, first + s, jx[s], jy[s], lx[s], ly[s], slot + s));
+	}
+}
+
+// Semianchura del intervalo de confianza al 95% de la luminancia, relativa a su media
+// (infinita con menos de dos muestras)
+static double relativeHalfWidth(const RunningStats& stats) {
+	if (stats.n < 2) return std::numeric_limits<double>::infinity();
+	return 1.96 * std::sqrt(stats.variance() / stats.n) / std::max(stats.mean, 1e-3);
+}
+
+// Muestreo adaptativo del parche [px, pw) x [py, ph). Cada pixel decide sus muestras solo con su
+// propia luminancia, asi que la imagen no depende de como se reparta entre hilos o procesos. Se
+// muestrea por tandas que empiezan en 2 y doblan el total (2, 4, 8...) hasta que el intervalo de
+// confianza relativo baja de options.adaptive: los pixeles faciles (cielo, suelo liso) paran antes
+// de ns, tambien con ns = 4. Los que llegan a ns sin converger siguen hasta las muestras que pide su
+// intervalo (se estrecha como 1 / sqrt(n)), como mucho adaptiveMax * ns. No hay un presupuesto
+// comun: el total depende de la escena y del umbral. Se recorre por tiles de STREAM_TILE x STREAM_TILE
+// pixeles: las tandas de los pixeles del tile que siguen sin converger se trazan juntas con traceWaves.
+// Devuelve en accum el color medio de cada pixel.
+long long renderAdaptive(Scene& world, Camera& cam, Sampler* sampler, int w, int h, int ns, int px, int py, int pw, int ph,
+	int frame, const RenderOptions& options, std::vector<float>& buf, std::vector<Vec3>& accum, const PrimaryVisibility* prepass = nullptr) {
 	int patch_w = pw - px;
-	// Scene world = randomScene();
-	Scene world = loadObjectsFromFile("../../../../MPI/Scene1.txt");
-	world.setSkyColor(Vec3(0.5f, 0.7f, 1.0f));
-	world.setInfColor(Vec3(1.0f, 1.0f, 1.0f));
+	accum.assign(patch_w * (ph - py), Vec3(0, 0, 0));
+	int maxSamples = ns * options.adaptiveMax;
+	int maxBatch = int(buf.size() / 4);
+	long long samplesTaken = 0;
+
+	// estado de cada pixel del tile: la tanda en curso tiene su color en colors[first, first + n)
+	struct PixelState {
+		int i, j;
+		RunningStats stats;
+		int taken, limit, first, n;
+	};
+	std::vector<PixelState> tile;
+	std::vector<PathState> paths;
+	std::vector<Vec3> colors;
+	int wave = 0;
+	StreamStats unused;
+
+	for (int ty = py; ty < ph; ty += STREAM_TILE) {
+		for (int tx = px; tx < pw; tx += STREAM_TILE) {
+			tile.clear();
+			for (int j = ty; j < std::min(ty + STREAM_TILE, ph); j++) {
+				for (int i = tx; i < std::min(tx + STREAM_TILE, pw); i++) {
+					PixelState p;
+					p.i = i;
+					p.j = j;
+					p.taken = 0;
+					p.limit = ns;
+					tile.push_back(p);
+				}
+			}
 
-	Vec3 lookfrom(13, 2, 3);
-	Vec3 lookat(0, 0, 0);
-	float dist_to_focus = 10.0;
-	float aperture = 0.1f;
+			bool pending = true;
+			while (pending) {
+				paths.clear();
+				for (PixelState& p : tile) {
+					p.first = int(paths.size());
+					p.n = p.taken < p.limit ? std::min(std::min(std::max(p.taken, 2), p.limit - p.taken), maxBatch) : 0;
+					if (p.n > 0) pixelPaths(cam, sampler, p.i, p.j, w, h, p.taken, p.n, frame, buf, p.first, paths);
+				}
+				colors.assign(paths.size(), Vec3(0, 0, 0));
+				traceWaves(world, sampler, frame, paths, colors.data(), prepass, false, wave, unused);
+
+				pending = false;
+				for (PixelState& p : tile) {
+					if (p.n == 0) continue;
+					Vec3& col = accum[(p.j - py) * patch_w + (p.i - px)];
+					for (int s = 0; s < p.n; s++) {
+						col += colors[p.first + s];
+						p.stats.add(luminance(colors[p.first + s]));
+					}
+					p.taken += p.n;
 
-	Camera cam(lookfrom, lookat, Vec3(0, 1, 0), 20, float(w) / float(h), aperture, dist_to_focus);
+					double e = relativeHalfWidth(p.stats);
+					if (e <= options.adaptive) p.limit = p.taken;
+					else if (p.taken >= ns) {
+						double need = std::ceil(p.taken * (e / options.adaptive) * (e / options.adaptive));
+						p.limit = int(std::min(double(maxSamples), need));
+					}
+					if (p.taken < p.limit) pending = true;
+				}
+			}
+			for (const PixelState& p : tile) {
+				accum[(p.j - py) * patch_w + (p.i - px)] /= float(p.taken);
+				samplesTaken += p.taken;
+			}
+		}
+	}
+	return samplesTaken;
+}
 
-	for (int j = 0; j < (ph - py); j++) {
-		for (int i = 0; i < (pw - px); i++) {
+// Render progresivo del parche [px, pw) x [py, ph): cada pasada anade una muestra a cada pixel en un
+// buffer de acumulacion en float, hasta llegar a ns muestras por pixel o agotar options.progressive
+// segundos. El plazo se mira en cada banda de STREAM_TILE filas, por eso se cuentan las muestras de
+// cada pixel; la primera pasada se completa siempre. Cada banda de una pasada es una tanda de
+// traceWaves, tile a tile. Devuelve en accum el color medio de cada pixel del parche.
+long long renderProgressive(Scene& world, Camera& cam, Sampler* sampler, int w, int h, int ns, int px, int py, int pw, int ph,
+	int frame, const RenderOptions& options, std::vector<Vec3>& accum, const PrimaryVisibility* prepass = nullptr) {
+	double deadline = omp_get_wtime() + options.progressive;
+	int patch_w = pw - px;
+	int patch_h = ph - py;
+	accum.assign(patch_w * patch_h, Vec3(0, 0, 0));
+	std::vector<int> count(patch_w * patch_h, 0);
+	std::vector<PathState> paths;
+	int wave = 0;
+	StreamStats unused;
+	long long samplesTaken = 0;
+
+	bool timeLeft = true;
+	for (int pass = 0; pass < ns && timeLeft; pass++) {
+		for (int ty = py; ty < ph; ty += STREAM_TILE) {
+			if (pass > 0 && omp_get_wtime() >= deadline) {
+				timeLeft = false;
+				break;
+			}
+			paths.clear();
+			for (int tx = px; tx < pw; tx += STREAM_TILE) {
+				for (int j = ty; j < std::min(ty + STREAM_TILE, ph); j++) {
+					for (int i = tx; i < std::min(tx + STREAM_TILE, pw); i++) {
+						int k = (j - py) * patch_w + (i - px);
+						float jx, jy, lx, ly;
+						sampler->getCameraSamples(frame, i, j, pass, 1, &jx, &jy, &lx, &ly);
+						sampleDisk(1, &lx, &ly);
+						paths.push_back(cameraPath(cam, i, j, w, h, pass, jx, jy, lx, ly, k));
+						count[k]++;
+					}
+				}
+			}
+			samplesTaken += paths.size();
+			traceWaves(world, sampler, frame, paths, accum.data(), prepass, false, wave, unused);
+		}
+	}
+
+	for (size_t k = 0; k < accum.size(); k++) {
+		accum[k] /= float(count[k]);
+	}
+	return samplesTaken;
+}
+
+// Rayos primarios en paquetes de size x size pixeles: para cada muestra los rayos del paquete
+// recorren juntos la escena hasta su primer choque y desde ahi cada uno sigue por separado.
+// Deja en accum la media de las ns muestras de cada pixel del patch.
+long long renderPackets(Scene& world, Camera& cam, Sampler* sampler, int w, int h, int ns, int px, int py, int pw, int ph,
+	int frame, int size, std::vector<Vec3>& accum) {
+	int patch_w = pw - px;
+	int patch_h = ph - py;
+	accum.assign(patch_w * patch_h, Vec3(0, 0, 0));
 
-			Vec3 col(0, 0, 0);
+	Ray rays[Accelerator::MAX_PACKET];
+	Object* hits[Accelerator::MAX_PACKET];
+	CollisionData cd[Accelerator::MAX_PACKET];
+	int pi[Accelerator::MAX_PACKET], pj[Accelerator::MAX_PACKET];
+
+	for (int ty = py; ty < ph; ty += size) {
+		for (int tx = px; tx < pw; tx += size) {
 			for (int s = 0; s < ns; s++) {
-				float u = float(i + px + Mirandom()) / float(w);
-				float v = float(j + py + Mirandom()) / float(h);
-				Ray r = cam.get_ray(u, v);
-				col += world.getSceneColor(r);
-			}
-			col /= float(ns);
-			col = Vec3(sqrt(col[0]), sqrt(col[1]), sqrt(col[2]));
+				int n = 0;
+				for (int j = ty; j < std::min(ty + size, ph); j++) {
+					for (int i = tx; i < std::min(tx + size, pw); i++) {
+						float jx, jy, lx, ly;
+						sampler->getCameraSamples(frame, i, j, s, 1, &jx, &jy, &lx, &ly);
+						sampleDisk(1, &lx, &ly);
+						rays[n] = cam.get_ray(float(i + jx) / float(w), float(j + jy) / float(h), Vec3(lx, ly, 0));
+						pi[n] = i;
+						pj[n] = j;
+						n++;
+					}
+				}
 
-			img[(j * patch_w + i) * 3 + 2] = char(255.99 * col[0]);
-			img[(j * patch_w + i) * 3 + 1] = char(255.99 * col[1]);
-			img[(j * patch_w + i) * 3 + 0] = char(255.99 * col[2]);
+				world.closestHitPacket(rays, n, hits, cd);
+				for (int k = 0; k < n; k++) {
+					sampler->startPixelSample(frame, pi[k], pj[k], s, 4);
+					accum[(pj[k] - py) * patch_w + (pi[k] - px)] += world.getSceneColor(rays[k], hits[k], cd[k], sampler);
+				}
+			}
 		}
 	}
+
+	for (size_t k = 0; k < accum.size(); k++) {
+		accum[k] /= float(ns);
+	}
+	return (long long)patch_w * patch_h * ns;
 }
 
-void rayTracingCPU(unsigned char* img, int w, int h, int ns = 10, int px = 0, int py = 0, int pw = -1, int ph = -1) {
-	if (pw == -1) pw = w;
-	if (ph == -1) ph = h;
+// Trazado por tandas, el render con ns fijo: los caminos de las ns muestras de cada tile de
+// STREAM_TILE x STREAM_TILE pixeles avanzan juntos rebote a rebote con traceWaves. Con sorted
+// (--stream=sorted) cada tanda de rebotes se ordena antes de trazarla. Con prepass el primer
+// choque sale del pre-paso de visibilidad. Deja en accum la media de las ns muestras de cada
+// pixel del patch.
+long long renderStream(Scene& world, Camera& cam, Sampler* sampler, int w, int h, int ns, int px, int py, int pw, int ph,
+	int frame, bool sorted, std::vector<Vec3>& accum, StreamStats* stats, const PrimaryVisibility* prepass = nullptr) {
 	int patch_w = pw - px;
-	// Scene world = randomScene();
-	Scene world = loadObjectsFromFile("../../../../MPI/Scene1.txt");
+	int patch_h = ph - py;
+	accum.assign(patch_w * patch_h, Vec3(0, 0, 0));
+
+	std::vector<PathState> paths;
+	StreamStats local;
+	int wave = 0;
+
+	for (int ty = py; ty < ph; ty += STREAM_TILE) {
+		for (int tx = px; tx < pw; tx += STREAM_TILE) {
+			paths.clear();
+			for (int j = ty; j < std::min(ty + STREAM_TILE, ph); j++) {
+				for (int i = tx; i < std::min(tx + STREAM_TILE, pw); i++) {
+					for (int s = 0; s < ns; s++) {
+						float jx, jy, lx, ly;
+						sampler->getCameraSamples(frame, i, j, s, 1, &jx, &jy, &lx, &ly);
+						sampleDisk(1, &lx, &ly);
+						paths.push_back(cameraPath(cam, i, j, w, h, s, jx, jy, lx, ly, (j - py) * patch_w + (i - px)));
+					}
+				}
+			}
+			traceWaves(world, sampler, frame, paths, accum.data(), prepass, sorted, wave, local);
+		}
+	}
+
+	for (size_t k = 0; k < accum.size(); k++) {
+		accum[k] /= float(ns);
+	}
+	if (stats) {
+		#pragma omp atomic
+		stats->missesUnsorted += local.missesUnsorted;
+		#pragma omp atomic
+		stats->missesSorted += local.missesSorted;
+	}
+	return (long long)patch_w * patch_h * ns;
+}
+
+// Corrige gamma y escribe el color en la posicion idx de la imagen (BGR)
+void writePixel(unsigned char* img, int idx, Vec3 col) {
+	col = Vec3(sqrt(col[0]), sqrt(col[1]), sqrt(col[2]));
+
+	img[idx * 3 + 2] = char(255.99 * col[0]);
+	img[idx * 3 + 1] = char(255.99 * col[1]);
+	img[idx * 3 + 0] = char(255.99 * col[2]);
+}
+
+// Carga la escena y construye su estructura de aceleracion. Se hace una vez por proceso
+// y la escena resultante la comparten todos los hilos, que solo la leen.
+// Si hay una cache valida de la escena se usa; si no, se crea (solo si writeCache).
+Scene createWorld(const RenderOptions& options, bool writeCache = true) {
+	std::string filename = "../../../../MPI/Scene1.txt";
+	Scene world;
+	std::string variant = options.groundPlane ? "plane" : "";
+	if (!options.sceneCache || !loadSceneCache(filename, options.accel, world, variant)) {
+		// world = randomScene();
+		world = loadObjectsFromFile(filename, options.groundPlane);
+		if (!world.build(options.accel)) {
+			std::cerr << "Error: estructura de aceleracion desconocida: " << options.accel << std::endl;
+			exit(-1);
+		}
+		if (options.sceneCache && writeCache) saveSceneCache(filename, options.accel, world, variant);
+	}
+	// la rejilla y los BVH anchos no saben reajustarse: con objetos en movimiento se reconstruyen
+	// enteros en cada fotograma (avisa solo el proceso que escribe la cache)
+	bool rebuilds = options.accel == "grid" || options.accel == "bvh4" || options.accel == "bvh8";
+	if (world.isAnimated() && rebuilds && writeCache) {
+		std::cerr << "CUIDADO: --accel=" << options.accel << " no se reajusta y se reconstruye en cada fotograma; con objetos en movimiento conviene bvh o lbvh" << std::endl;
+	}
 	world.setSkyColor(Vec3(0.5f, 0.7f, 1.0f));
 	world.setInfColor(Vec3(1.0f, 1.0f, 1.0f));
+	return world;
+}
 
+Camera createCamera(int w, int h) {
 	Vec3 lookfrom(13, 2, 3);
 	Vec3 lookat(0, 0, 0);
 	float dist_to_focus = 10.0;
 	float aperture = 0.1f;
 
+	return Camera(lookfrom, lookat, Vec3(0, 1, 0), 20, float(w) / float(h), aperture, dist_to_focus);
+}
+
+// Rapidez de la estructura de aceleracion frente al recorrido lineal: cociente de tiempos
+// buscando el choque mas cercano de n x n rayos primarios por el centro de los pixeles
+double accelSpeedup(Scene& world, int w, int h, int n) {
+	Camera cam = createCamera(w, h);
+	std::vector<Ray> rays;
+	rays.reserve(n * n);
+	for (int j = 0; j < n; j++) {
+		for (int i = 0; i < n; i++) {
+			rays.push_back(cam.get_ray((i + 0.5f) / n, (j + 0.5f) / n, Vec3(0, 0, 0)));
+		}
+	}
+
+	CollisionData cd;
+	int hitsAccel = 0, hitsLinear = 0;
+	double t0 = omp_get_wtime();
+	for (const Ray& r : rays) {
+		if (world.closestHit(r, 0.001f, std::numeric_limits<float>::max(), cd)) hitsAccel++;
+	}
+	double t1 = omp_get_wtime();
+	for (const Ray& r : rays) {
+		if (world.closestHitLinear(r, 0.001f, std::numeric_limits<float>::max(), cd)) hitsLinear++;
+	}
+	double t2 = omp_get_wtime();
+
+	if (hitsAccel != hitsLinear) {
+		std::cerr << "Aviso: la estructura de aceleracion da " << hitsAccel << " choques y el recorrido lineal " << hitsLinear << std::endl;
+	}
+	return (t2 - t1) / std::max(t1 - t0, 1e-9);
+}
+
+long long rayTracingCPULocalCoord(Scene& world, unsigned char* img, int w, int h, int ns = 10, int px = 0, int py = 0, int pw = -1, int ph = -1, int frame = 0, const RenderOptions& options = RenderOptions(), StreamStats* streamStats = nullptr) {
+	if (pw == -1) pw = w;
+	if (ph == -1) ph = h;
+	int patch_w = pw - px;
+	Camera cam = createCamera(w, h);
+
+	Sampler* sampler = createSampler(options.sampler, ns);
+
+	// muestras de camara (jitter del pixel y lente) de una tanda de muestras de un pixel
+	std::vector<float> buf(4 * std::max(ns, 4));
+	long long samplesTaken = 0;
+
+	// paquetes de rayos primarios solo con ns fijo (el muestreo adaptativo decide las muestras de cada pixel)
+	bool packets = options.packet > 0 && options.adaptive <= 0.0f;
+	bool stream = options.stream != "off" && options.adaptive <= 0.0f;
+
+	// pre-paso de visibilidad primaria: lo usan todos los render menos el de paquetes
+	PrimaryVisibility visibility;
+	const PrimaryVisibility* prepass = nullptr;
+	if (options.prepass && (options.progressive > 0.0 || !packets || stream)) {
+		visibility.build(cam, world, w, h, px, py, pw, ph);
+		prepass = &visibility;
+	}
+
+	std::vector<Vec3> accum;
+	if (options.progressive > 0.0) samplesTaken = renderProgressive(world, cam, sampler, w, h, ns, px, py, pw, ph, frame, options, accum, prepass);
+	else if (options.adaptive > 0.0f) samplesTaken = renderAdaptive(world, cam, sampler, w, h, ns, px, py, pw, ph, frame, options, buf, accum, prepass);
+	else if (packets && !stream) samplesTaken = renderPackets(world, cam, sampler, w, h, ns, px, py, pw, ph, frame, options.packet, accum);
+	// ns fijo: por tandas, ordenadas solo con --stream=sorted
+	else samplesTaken = renderStream(world, cam, sampler, w, h, ns, px, py, pw, ph, frame, options.stream == "sorted", accum, streamStats, prepass);
+	for (int j = 0; j < (ph - py); j++) {
+		for (int i = 0; i < (pw - px); i++) {
+			writePixel(img, j * patch_w + i, accum[j * patch_w + i]);
+		}
+	}
+
+	delete sampler;
+	return samplesTaken;
+}
+
+long long rayTracingCPU(Scene& world, unsigned char* img, int w, int h, int ns = 10, int px = 0, int py = 0, int pw = -1, int ph = -1, int frame = 0, const RenderOptions& options = RenderOptions(), StreamStats* streamStats = nullptr) {
+	if (pw == -1) pw = w;
+	if (ph == -1) ph = h;
+	int patch_w = pw - px;
 	//std::cout << "RT de " << px << " a " << pw << std::endl;
 
-	Camera cam(lookfrom, lookat, Vec3(0, 1, 0), 20, float(w) / float(h), aperture, dist_to_focus);
+	Camera cam = createCamera(w, h);
 
-	for (int j = py; j < ph; j++) {
-		for (int i = px; i < pw; i++) {
+	Sampler* sampler = createSampler(options.sampler, ns);
 
-			Vec3 col(0, 0, 0);
-			for (int s = 0; s < ns; s++) {
-				float u = float(i + Mirandom()) / float(w);
-				float v = float(j + Mirandom()) / float(h);
-				Ray r = cam.get_ray(u, v);
-				col += world.getSceneColor(r);
-			}
-			col /= float(ns);
-			col = Vec3(sqrt(col[0]), sqrt(col[1]), sqrt(col[2]));
+	// muestras de camara (jitter del pixel y lente) de una tanda de muestras de un pixel
+	std::vector<float> buf(4 * std::max(ns, 4));
+	long long samplesTaken = 0;
+
+	// paquetes de rayos primarios solo con ns fijo (el muestreo adaptativo decide las muestras de cada pixel)
+	bool packets = options.packet > 0 && options.adaptive <= 0.0f;
+	bool stream = options.stream != "off" && options.adaptive <= 0.0f;
 
-			img[(j * w + i) * 3 + 2] = char(255.99 * col[0]);
-			img[(j * w + i) * 3 + 1] = char(255.99 * col[1]);
-			img[(j * w + i) * 3 + 0] = char(255.99 * col[2]);
+	// pre-paso de visibilidad primaria: lo usan todos los render menos el de paquetes
+	PrimaryVisibility visibility;
+	const PrimaryVisibility* prepass = nullptr;
+	if (options.prepass && (options.progressive > 0.0 || !packets || stream)) {
+		visibility.build(cam, world, w, h, px, py, pw, ph);
+		prepass = &visibility;
+	}
+
+	std::vector<Vec3> accum;
+	if (options.progressive > 0.0) samplesTaken = renderProgressive(world, cam, sampler, w, h, ns, px, py, pw, ph, frame, options, accum, prepass);
+	else if (options.adaptive > 0.0f) samplesTaken = renderAdaptive(world, cam, sampler, w, h, ns, px, py, pw, ph, frame, options, buf, accum, prepass);
+	else if (packets && !stream) samplesTaken = renderPackets(world, cam, sampler, w, h, ns, px, py, pw, ph, frame, options.packet, accum);
+	// ns fijo: por tandas, ordenadas solo con --stream=sorted
+	else samplesTaken = renderStream(world, cam, sampler, w, h, ns, px, py, pw, ph, frame, options.stream == "sorted", accum, streamStats, prepass);
+	for (int j = py; j < ph; j++) {
+		for (int i = px; i < pw; i++) {
+			writePixel(img, j * w + i, accum[(j - py) * patch_w + (i - px)]);
 		}
 	}
+
+	delete sampler;
+	return samplesTaken;
 }
 
 Patch divideByRows(int w, int h, int np, int rank) {
@@ -372,6 +980,20 @@ Patch subdivideByBlocks(int w, int h, int nt, int tid, int offsetX, int offsetY)
 
 int main(int argc, char** argv) {
 	////////// threadsPorProceso, nFotogramas, width, height, ns, strategy (cols|rows|blocks), subStrategy (cols|rows|blocks)
+	// opcionales: --sampler=random|sobol|cmj (cmj estratifica las ns muestras de cada pixel)
+	//             --adaptive=umbral, --adaptive-max=k (muestreo adaptativo por pixel)
+	//             --progressive=segundos (pasadas de 1 muestra hasta ns o hasta agotar el tiempo)
+	//             --accel=auto|bvh|lbvh|bvh4|bvh8|grid|simd|none (estructura de aceleracion; none recorre todos los objetos;
+	//             auto, por defecto, usa simd con pocas esferas, que las prueba todas a la vez, y bvh si no)
+	//             --stream=unsorted|sorted (con ns fijo los caminos de cada tile siempre avanzan por tandas de
+	//             rebotes; sorted ordena cada tanda antes de trazarla y unsorted es como sin la opcion)
+	//             --prepass=1 (primer choque entre los candidatos de cada tile, proyectando las esferas con la camara)
+	//             --ground-plane=1 (las esferas enormes por debajo de la escena se cargan como suelo plano horizontal)
+	//             --packet=4|8 (rayos primarios en paquetes de 4x4 u 8x8 pixeles, con ns fijo)
+	//             --scene-cache=0 (no usa ni escribe la cache <escena>.<accel>.cache)
+	//             --accel-bench=n (mide la aceleracion frente al recorrido lineal con n x n rayos primarios)
+	// columnas del CSV tras los tiempos: muestras, construccion de la escena, aceleracion frente al
+	// recorrido lineal y reduccion de fallos de cache al ordenar los rebotes (--stream=sorted)
 	int threadsPorProceso = std::atoi(argv[1]);
 	int nFotogramas = std::atoi(argv[2]);
 	int w = std::atoi(argv[3]);
@@ -379,6 +1001,7 @@ int main(int argc, char** argv) {
 	int ns = std::atoi(argv[5]);
 	std::string strategy = argv[6];
 	std::string subStrategy = argv[7];
+	RenderOptions options = parseRenderOptions(argc, argv);
 
 	MPI_Init(&argc, &argv);
 	int worldRank, worldNP;
@@ -444,12 +1067,20 @@ int main(int argc, char** argv) {
 		<< " maneja columnas [" << my.px << "," << my.pw << "] "
 		<< "y filas [" << my.py << "," << my.ph << "]\n";
 		*/
+	// escena y estructura de aceleracion, una vez por proceso (LBVH con threadsPorProceso hilos)
+	omp_set_num_threads(threadsPorProceso);
+	double build_start = omp_get_wtime();
+	Scene world = createWorld(options, worldRank == 0);
+	world.setFrame(frameIdx); // objetos en movimiento: se reajusta la estructura a este fotograma
+	double buildTime = omp_get_wtime() - build_start;
+
 	// raytracing y medición temporal
 	unsigned char* local_data = (unsigned char*)calloc(w * h * 3, 1);
 	double init_time = 0.0, end_time = 0.0;
 	if (rank == 0) init_time = omp_get_wtime();
 
-	omp_set_num_threads(threadsPorProceso);
+	StreamStats streamStats;
+	long long localSamples = 0;
 
 	#pragma omp parallel
 	{
@@ -475,7 +1106,9 @@ int main(int argc, char** argv) {
 		}
 		*/
 
-		rayTracingCPU(local_data, w, h, ns, subpatch.px, subpatch.py, subpatch.pw, subpatch.ph);
+		long long taken = rayTracingCPU(world, local_data, w, h, ns, subpatch.px, subpatch.py, subpatch.pw, subpatch.ph, frameIdx, options, &streamStats);
+		#pragma omp atomic
+		localSamples += taken;
 	}
 
 	unsigned char* global_data = nullptr;
@@ -500,6 +1133,14 @@ int main(int argc, char** argv) {
 
 	MPI_Comm_free(&frameComm);
 
+	long long totalSamples = 0;
+	MPI_Reduce(&localSamples, &totalSamples, 1, MPI_LONG_LONG, MPI_SUM, 0, MPI_COMM_WORLD);
+	long long localMisses[2] = { streamStats.missesUnsorted, streamStats.missesSorted };
+	long long totalMisses[2] = { 0, 0 };
+	MPI_Reduce(localMisses, totalMisses, 2, MPI_LONG_LONG, MPI_SUM, 0, MPI_COMM_WORLD);
+	double maxBuildTime = 0.0;
+	MPI_Reduce(&buildTime, &maxBuildTime, 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+
 	// enviar tiempos de cada fotograma (solo si no es el proceso 0 global)
 	if (rank == 0 && worldRank != 0) {
 		MPI_Send(&frameTime, 1, MPI_DOUBLE, 0, frameIdx, MPI_COMM_WORLD);
@@ -515,6 +1156,9 @@ int main(int argc, char** argv) {
 		}
 		double totalTime = *std::max_element(times.begin(), times.end());
 
+		double speedup = 0.0;
+		if (options.accelBench > 0) speedup = accelSpeedup(world, w, h, options.accelBench);
+
 		// para el CSV
 		std::cout << nFotogramas << ","
 			<< w << ","
@@ -527,6 +1171,10 @@ int main(int argc, char** argv) {
 		for (double t : times) {
 			std::cout << "," << t;
 		}
+		std::cout << "," << totalSamples; // muestras realmente tomadas (con --adaptive no es w*h*ns)
+		std::cout << "," << maxBuildTime; // carga de la escena y construccion de la estructura de aceleracion (el mas lento)
+		std::cout << "," << speedup; // aceleracion frente al recorrido lineal (0 sin --accel-bench)
+		std::cout << "," << (totalMisses[1] > 0 ? double(totalMisses[0]) / totalMisses[1] : 0.0);
 		std::cout << std::endl;
 	}
 
@@ -1,23 +1,68 @@
 #include "random.h"
 
-#include <cstdlib>
+#include <cmath>
 
-float Mirandom() {
-	return rand() / (RAND_MAX + 1.0f);
+static const float PI = 3.14159265358979f;
+
+// Finalizador de splitmix64: mezcla todos los bits de la clave
+static uint64_t hash64(uint64_t x) {
+	x ^= x >> 30;
+	x *= 0xbf58476d1ce4e5b9ULL;
+	x ^= x >> 27;
+	x *= 0x94d049bb133111ebULL;
+	x ^= x >> 31;
+	return x;
 }
 
-Vec3 randomNormalSphere() {
-	Vec3 p(2.0f * Vec3(Mirandom(), Mirandom(), Mirandom()) - Vec3(1, 1, 1));
-	while (p.squared_length() >= 1.0) {
-		p = 2.0f * Vec3(Mirandom(), Mirandom(), Mirandom()) - Vec3(1, 1, 1);
-	}
-	return p;
+void randomInit(uint64_t seed, uint64_t sequence, RandomState* local_rand_state) {
+	local_rand_state->state = 0u;
+	local_rand_state->inc = (sequence << 1u) | 1u;
+	randomNext(local_rand_state);
+	local_rand_state->state += seed;
+	randomNext(local_rand_state);
+}
+
+void randomInitSample(int frame, int x, int y, int sample, RandomState* local_rand_state) {
+	uint64_t key = hash64((uint64_t(uint32_t(frame)) << 32) | uint32_t(sample));
+	key = hash64(key ^ ((uint64_t(uint32_t(y)) << 32) | uint32_t(x)));
+	randomInit(key ^ 42u, hash64(key), local_rand_state);
+}
+
+// Transformaciones de uniformes en [0, 1) a las distintas distribuciones
+
+static inline void mapUnitVector(float u1, float u2, float& x, float& y, float& z) {
+	z = 1.0f - 2.0f * u1;
+	float r = std::sqrt(std::fmax(0.0f, 1.0f - z * z));
+	float phi = 2.0f * PI * u2;
+	x = r * std::cos(phi);
+	y = r * std::sin(phi);
+}
+
+static inline void mapDisk(float u1, float u2, float& x, float& y) {
+	float r = std::sqrt(u1);
+	float phi = 2.0f * PI * u2;
+	x = r * std::cos(phi);
+	y = r * std::sin(phi);
+}
+
+Vec3 sampleUnitVector(float u1, float u2) {
+	float x, y, z;
+	mapUnitVector(u1, u2, x, y, z);
+	return Vec3(x, y, z);
+}
+
+Vec3 sampleInSphere(float u1, float u2, float u3) {
+	return std::cbrt(u3) * sampleUnitVector(u1, u2);
+}
+
+Vec3 sampleDisk(float u1, float u2) {
+	float x, y;
+	mapDisk(u1, u2, x, y);
+	return Vec3(x, y, 0);
 }
 
-Vec3 randomNormalDisk() {
-	Vec3 p(2.0f * Vec3(Mirandom(), Mirandom(), 0) - Vec3(1, 1, 0));
-	while (dot(p, p) >= 1.0f) {
-		p = 2.0f * Vec3(Mirandom(), Mirandom(), 0) - Vec3(1, 1, 0);
+void sampleDisk(int n, float* x, float* y) {
+	for (int k = 0; k < n; k++) {
+		mapDisk(x[k], y[k], x[k], y[k]);
 	}
-	return p;
 }
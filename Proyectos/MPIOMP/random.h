@@ -1,7 +1,43 @@
 #pragma once
 
+#include <cstdint>
+
 #include "Vec3.h"
 
-float Mirandom();
-Vec3 randomNormalSphere();
-Vec3 randomNormalDisk();
+// Estado de un generador PCG32 (M. O'Neill, pcg-random.org). Cada hilo lleva su
+// propio estado y lo pasa explicitamente, igual que curandState en la version CUDA,
+// asi que no hay estado global compartido ni contencion entre hilos.
+struct RandomState {
+	uint64_t state;
+	uint64_t inc;
+};
+
+void randomInit(uint64_t seed, uint64_t sequence, RandomState* local_rand_state);
+
+// Inicializa la secuencia de una muestra concreta a partir de un hash de
+// (fotograma, x, y, muestra), como render_init en CUDA con curand_init(42, pixel_index, ...).
+// La imagen resultante no depende de como se reparta entre hilos o procesos.
+void randomInitSample(int frame, int x, int y, int sample, RandomState* local_rand_state);
+
+inline uint32_t randomNext(RandomState* local_rand_state) {
+	uint64_t old = local_rand_state->state;
+	local_rand_state->state = old * 6364136223846793005ULL + local_rand_state->inc;
+	uint32_t xorshifted = uint32_t(((old >> 18u) ^ old) >> 27u);
+	uint32_t rot = uint32_t(old >> 59u);
+	return (xorshifted >> rot) | (xorshifted << ((0u - rot) & 31u));
+}
+
+// Uniforme en [0, 1)
+inline float Mirandom(RandomState* local_rand_state) {
+	return (randomNext(local_rand_state) >> 8) * (1.0f / 16777216.0f);
+}
+
+// Transforman uniformes en [0, 1) en cada distribucion, con un numero fijo de uniformes por
+// muestra y sin bucles, para usarlas con cualquier fuente de uniformes (ver Sampler.h)
+Vec3 sampleUnitVector(float u1, float u2);				// uniforme sobre la superficie de la esfera unidad
+Vec3 sampleInSphere(float u1, float u2, float u3);		// uniforme dentro de la esfera unidad
+Vec3 sampleDisk(float u1, float u2);					// uniforme dentro del disco unidad (z = 0)
+
+// Version por lotes: transforma en el sitio n pares de uniformes (x[k], y[k]) en
+// puntos del disco. Es un bucle sin saltos que se puede vectorizar.
+void sampleDisk(int n, float* x, float* y);
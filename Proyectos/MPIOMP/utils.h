@@ -7,3 +7,20 @@ void writeBMP(const char* filename, unsigned char* data, int w, int h);
 float schlick(float cosine, float ref_idx);
 bool refract(const Vec3& v, const Vec3& n, float ni_over_nt, Vec3& refracted);
 Vec3 reflect(const Vec3& v, const Vec3& n);
+
+float luminance(const Vec3& c);
+
+// Media y varianza acumuladas muestra a muestra (algoritmo de Welford)
+struct RunningStats {
+	int n = 0;
+	double mean = 0.0;
+	double m2 = 0.0;
+
+	void add(double x) {
+		n++;
+		double delta = x - mean;
+		mean += delta / n;
+		m2 += delta * (x - mean);
+	}
+	double variance() const { return n > 1 ? m2 / (n - 1) : 0.0; }
+};
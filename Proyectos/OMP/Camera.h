@@ -13,7 +13,6 @@
 
 #include "Vec3.h"
 #include "Ray.h"
-#include "random.h"
 
 class Camera {
 public:
@@ -31,12 +30,23 @@ public:
         horizontal = 2*half_width*focus_dist*u;
         vertical = 2*half_height*focus_dist*v;
     }
-    Ray get_ray(float s, float t) {
-        Vec3 rd = lens_radius*randomNormalDisk();
+    // disk: muestra ya generada del disco unidad para la apertura de la lente
+    Ray get_ray(float s, float t, const Vec3& disk) {
+        Vec3 rd = lens_radius*disk;
         Vec3 offset = u * rd.x() + v * rd.y();
         return Ray(origin + offset, lower_left_corner + s*horizontal + t*vertical - origin - offset);
     }
 
+    // base de la camara (pre-paso de visibilidad primaria)
+    Vec3 getOrigin() const { return origin; }
+    Vec3 getLowerLeftCorner() const { return lower_left_corner; }
+    Vec3 getHorizontal() const { return horizontal; }
+    Vec3 getVertical() const { return vertical; }
+    Vec3 getU() const { return u; }
+    Vec3 getV() const { return v; }
+    Vec3 getW() const { return w; }
+    float getLensRadius() const { return lens_radius; }
+
 private:
     Vec3 origin;
     Vec3 lower_left_corner;
@@ -1,7 +1,8 @@
 #pragma once
 
 #include "utils.h"
-#include "random.h"
+#include "Sampler.h"
+#include "Vec3x.h"
 
 #include "Material.h"
 
@@ -9,7 +10,33 @@ class Crystalline : public Material {
 public:
 	Crystalline(float ri) : ref_idx(ri) {}
 
-	bool scatter(const Ray& r_in, const CollisionData& cd, Vec3& attenuation, Ray& scattered) const;
+	bool scatter(const Ray& r_in, const CollisionData& cd, Vec3& attenuation, Ray& scattered, Sampler* sampler) const;
+
+	// Trazado por tandas (ScatterLanes.h): uniforme de scatter y sus cuentas para N choques a la
+	// vez, con el indice de refraccion de cada uno
+	static void samples(Sampler* sampler, float* u) { u[0] = sampler->get1D(); }
+	template <int N>
+	static void scatterLanes(const Vec3xN<N>& dir, const Vec3xN<N>& normal, const FloatxN<N>& ref_idx, const float (*u)[3], Vec3xN<N>& direction) {
+		Vec3xN<N> reflected = reflect(dir, normal);
+		FloatxN<N> dn = dot(dir, normal);
+		FloatxN<N> length = dir.length();
+		int inside = dn > FloatxN<N>(0.0f);
+		FloatxN<N> cosIn = dn / length;
+		cosIn = sqrt(FloatxN<N>(1.0f) - ref_idx * ref_idx * (FloatxN<N>(1.0f) - cosIn * cosIn));
+		FloatxN<N> cosine = select(inside, cosIn, -dn / length);
+		FloatxN<N> ni_over_nt = select(inside, ref_idx, FloatxN<N>(1.0f) / ref_idx);
+		Vec3xN<N> outward(select(inside, -normal.x, normal.x), select(inside, -normal.y, normal.y), select(inside, -normal.z, normal.z));
+		Vec3xN<N> refracted = reflected;
+		int refracts = refract(dir, outward, ni_over_nt, refracted);
+		direction = reflected;
+		for (int k = 0; k < N; k++) {
+			float reflect_prob = (refracts >> k) & 1 ? schlick(cosine[k], ref_idx[k]) : 1.0f;
+			if (!(u[k][0] < reflect_prob)) direction.set(k, refracted.get(k));
+		}
+	}
+
+	int type() const { return MATERIAL_CRYSTALLINE; }
+	void params(float* p) const { p[0] = ref_idx; p[1] = p[2] = p[3] = 0.0f; }
 
 private:
 	float ref_idx;
@@ -7,8 +7,16 @@
 
 #include "Ray.h"
 #include "CollisionData.h"
+#include "Sampler.h"
+
+// tipo de material guardado en la cache de escena
+enum MaterialType { MATERIAL_DIFFUSE = 0, MATERIAL_METALLIC = 1, MATERIAL_CRYSTALLINE = 2 };
 
 class Material  {
 public:
-    virtual bool scatter(const Ray& ray, const CollisionData& cd, Vec3& attenuation, Ray& scattered) const = 0;
+    virtual bool scatter(const Ray& ray, const CollisionData& cd, Vec3& attenuation, Ray& scattered, Sampler* sampler) const = 0;
+
+    // MaterialType y hasta 4 parametros que lo describen (cache de escena)
+    virtual int type() const = 0;
+    virtual void params(float* p) const = 0;
 };
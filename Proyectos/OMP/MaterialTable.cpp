@@ -0,0 +1,47 @@
+#include "MaterialTable.h"
+
+#include <cstring>
+#include <iostream>
+
+#include "Diffuse.h"
+#include "Metallic.h"
+#include "Crystalline.h"
+
+MaterialTable::Key MaterialTable::key(int type, const float* p) {
+	Key k;
+	k[0] = uint32_t(type);
+	std::memcpy(&k[1], p, 4 * sizeof(float));
+	return k;
+}
+
+int MaterialTable::add(int type, const float* p, Arena& arena) {
+	Key k = key(type, p);
+	auto it = index.find(k);
+	if (it != index.end()) return it->second;
+
+	Material* m;
+	if (type == MATERIAL_DIFFUSE) m = arena.make<Diffuse>(Vec3(p[0], p[1], p[2]));
+	else if (type == MATERIAL_METALLIC) m = arena.make<Metallic>(Vec3(p[0], p[1], p[2]), p[3]);
+	else if (type == MATERIAL_CRYSTALLINE) m = arena.make<Crystalline>(p[0]);
+	else {
+		std::cerr << "Error: tipo de material desconocido: " << type << std::endl;
+		exit(-1);
+	}
+	int i = int(materials.size());
+	materials.push_back(m);
+	index[k] = i;
+	// el material puede ajustar sus parametros (fuzz de Metallic como mucho 1): tambien se
+	// encuentra por los que tiene de verdad
+	float q[4];
+	m->params(q);
+	index.insert(std::make_pair(key(type, q), i));
+	return i;
+}
+
+int MaterialTable::find(const Material* m) const {
+	float q[4];
+	m->params(q);
+	auto it = index.find(key(m->type(), q));
+	if (it == index.end() || materials[it->second] != m) return -1;
+	return it->second;
+}
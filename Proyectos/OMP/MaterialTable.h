@@ -0,0 +1,32 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <map>
+#include <vector>
+
+#include "Arena.h"
+#include "Material.h"
+
+// Materiales de una escena, sin repetidos: uno con el mismo tipo (MaterialType) y los mismos
+// parametros que otro ya guardado es ese mismo, y los objetos que lo usan apuntan todos a el.
+// En escenas grandes quedan pocos materiales distintos en memoria.
+class MaterialTable {
+public:
+	// Indice del material de tipo type con parametros p[0..3] (los de Material::params); si
+	// no estaba se crea en arena
+	int add(int type, const float* p, Arena& arena);
+	// Indice de un material igual a m, o -1 si no esta
+	int find(const Material* m) const;
+
+	Material* get(int i) const { return materials[i]; }
+	int size() const { return int(materials.size()); }
+
+private:
+	// tipo y bits de los parametros: solo se juntan materiales exactamente iguales
+	typedef std::array<uint32_t, 5> Key;
+	static Key key(int type, const float* p);
+
+	std::vector<Material*> materials;
+	std::map<Key, int> index;
+};
@@ -1,34 +1,153 @@
 #include "Scene.h"
 
-Vec3 Scene::getSceneColor(const Ray& r) {
-	return getSceneColor(r, 0);
+#include "Instance.h"
+#include "Vec3x.h"
+
+void Scene::addCluster(Cluster* c) {
+	clusters.push_back(arena->own(c));
 }
 
-Vec3 Scene::getSceneColor(const Ray& r, int depth) {
-	CollisionData cd;
-	Object* aux = nullptr;
-	bool hasCollided = false;
-	float closest = std::numeric_limits<float>::max();  // initially tmax = std::numeric_limits<float>::max()
-	for (auto& o : ol) {
-		if (o->checkCollision(r, 0.001f, closest, cd)) { // tmin = 0.001
-			aux = o;
-			closest = cd.time;
+bool Scene::build(const std::string& name) {
+	accel = nullptr;
+	for (Cluster* c : clusters) c->build(name);
+	if (name == "none") return true;
+
+	accel = arena->own(chooseAccelerator(name, ol));
+	if (!accel) return false;
+	accel->build(ol);
+	return true;
+}
+
+void Scene::setFrame(int frame) {
+	if (moving.empty()) return;
+	for (int i : moving) {
+		ol[i]->setFrame(frame);
+		packed[i] = packSphere(ol[i]);
+	}
+	if (accel && !accel->refit(ol, moving)) accel->build(ol);
+}
+
+Object* Scene::closestHit(const Ray& r, float t_min, float t_max, CollisionData& cd) {
+	if (!accel) return closestHitLinear(r, t_min, t_max, cd);
+	float closest;
+	Object* hit = accel->intersect(r, t_min, t_max, closest);
+	if (!hit) closest = t_max;
+	hit = hitUnbounded(r, t_min, closest, hit);
+	if (hit) hit = hit->hitAttributes(r, t_min, closest, cd);
+	return hit;
+}
+
+Object* Scene::closestHitLinear(const Ray& r, float t_min, float t_max, CollisionData& cd) {
+	float closest = t_max;
+	int i = hitPackedRun(packed.data(), ol.data(), int(ol.size()), r, t_min, closest);
+	Object* aux = i >= 0 ? ol[i] : nullptr;
+	aux = hitUnbounded(r, t_min, closest, aux);
+	if (aux) aux = aux->hitAttributes(r, t_min, closest, cd);
+	return aux;
+}
+
+Object* Scene::hitUnbounded(const Ray& r, float t_min, float& closest, Object* hit) {
+	for (Object* o : unbounded) {
+		if (o->hitDistance(r, t_min, closest, closest)) {
+			hit = o;
+		}
+	}
+	return hit;
+}
+
+void Scene::closestHitPacket(const Ray* rays, int n, Object** hits, CollisionData* cd) {
+	if (accel) {
+		float t[Accelerator::MAX_PACKET];
+		accel->intersectPacket(rays, n, 0.001f, std::numeric_limits<float>::max(), hits, t);
+		for (int k = 0; k < n; k++) {
+			if (!hits[k]) t[k] = std::numeric_limits<float>::max();
+			hits[k] = hitUnbounded(rays[k], 0.001f, t[k], hits[k]);
+		}
+		// punto y normal de los choques con esferas, 8 rayos a la vez; los demas uno a uno
+		for (int g = 0; g < n; g += 8) {
+			Vec3x8 o(Vec3(0, 0, 0)), d(Vec3(0, 0, 0)), center(Vec3(0, 0, 0));
+			Floatx8 tHit(0.0f), radius(1.0f);
+			int mask = 0;
+			for (int k = 0; k < 8 && g + k < n; k++) {
+				Object* hit = hits[g + k];
+				if (!hit) continue;
+				if (hit->shapeType() != SHAPE_SPHERE) {
+					hits[g + k] = hit->hitAttributes(rays[g + k], 0.001f, t[g + k], cd[g + k]);
+					continue;
+				}
+				const Sphere* s = static_cast<const Sphere*>(hit->getShape());
+				o.set(k, rays[g + k].origin());
+				d.set(k, rays[g + k].direction());
+				center.set(k, s->getCenter());
+				tHit[k] = t[g + k];
+				radius[k] = s->getRadius();
+				mask |= 1 << k;
+			}
+			if (!mask) continue;
+			Vec3x8 p = o + tHit * d;
+			Vec3x8 normal = (p - center) / radius;
+			for (int k = 0; mask; k++, mask >>= 1) {
+				if (!(mask & 1)) continue;
+				cd[g + k].time = tHit[k];
+				cd[g + k].p = p.get(k);
+				cd[g + k].normal = normal.get(k);
+			}
+		}
+		return;
+	}
+	for (int k = 0; k < n; k++) {
+		hits[k] = closestHitLinear(rays[k], 0.001f, std::numeric_limits<float>::max(), cd[k]);
+	}
+}
+
+Object* Scene::closestHitCounted(const Ray& r, CollisionData& cd, NodeCache& cache) {
+	if (!accel) {
+		// el recorrido lineal lee todas las esferas empaquetadas y los objetos que no lo son
+		for (size_t i = 0; i < ol.size(); i++) {
+			cache.touch(&packed[i]);
+			if (packed[i].r2 < 0.0f) {
+				cache.touch(&ol[i]);
+				cache.touch(ol[i]);
+			}
 		}
+		return closestHitLinear(r, 0.001f, std::numeric_limits<float>::max(), cd);
 	}
+	float closest;
+	Object* hit = accel->intersectCounted(r, 0.001f, std::numeric_limits<float>::max(), closest, cache);
+	if (!hit) closest = std::numeric_limits<float>::max();
+	hit = hitUnbounded(r, 0.001f, closest, hit);
+	if (hit) hit = hit->hitAttributes(r, 0.001f, closest, cd);
+	return hit;
+}
+
+Vec3 Scene::getBackground(const Ray& r) const {
+	Vec3 unit_direction = unit_vector(r.direction());
+	float t = 0.5f * (unit_direction.y() + 1.0f);
+	return (1.0f - t) * Vec3(1.0f, 1.0f, 1.0f) + t * Vec3(0.5f, 0.7f, 1.0f);
+}
+
+Vec3 Scene::getSceneColor(const Ray& r, Object* firstHit, const CollisionData& cd, Sampler* sampler) {
+	return shade(r, firstHit, cd, 0, sampler);
+}
+
+Vec3 Scene::getSceneColor(const Ray& r, int depth, Sampler* sampler) {
+	CollisionData cd;
+	Object* aux = closestHit(r, 0.001f, std::numeric_limits<float>::max(), cd); // tmin = 0.001
+	return shade(r, aux, cd, depth, sampler);
+}
 
+Vec3 Scene::shade(const Ray& r, Object* aux, const CollisionData& cd, int depth, Sampler* sampler) {
 	if (aux) {
 		Ray scattered;
 		Vec3 attenuation;
-		if (depth < d && aux->scatter(r, cd, attenuation, scattered)) {
-			return attenuation *getSceneColor(scattered, depth + 1);
+		if (depth < d && aux->scatter(r, cd, attenuation, scattered, sampler)) {
+			return attenuation *getSceneColor(scattered, depth + 1, sampler);
 		}
 		else {
 			return Vec3(0, 0, 0);
 		}
 	}
 	else {
-		Vec3 unit_direction = unit_vector(r.direction());
-		float t = 0.5f * (unit_direction.y() + 1.0f);
-		return (1.0f - t) * Vec3(1.0f, 1.0f, 1.0f) + t * Vec3(0.5f, 0.7f, 1.0f);
+		return getBackground(r);
 	}
 }
@@ -1,25 +1,101 @@
 #pragma once
 
+#include <memory>
+#include <string>
 #include <vector>
 
 #include "Object.h"
+#include "Accelerator.h"
+#include "Arena.h"
+#include "MaterialTable.h"
+#include "PackedSphere.h"
+
+class Cluster;
 
 class Scene {
 public:
-	Scene(int depth = 50) : ol(), sky(), inf(), d(depth) {}
+	Scene(int depth = 50) : ol(), arena(std::make_shared<Arena>()), accel(nullptr), sky(), inf(), d(depth) {}
 	Scene(const Scene& list) = default;
 
-	void add(Object* h) { ol.push_back(h); }
+	// Memoria de los objetos, formas y materiales de la escena (Arena::make), de sus clusters y
+	// de sus estructuras de aceleracion. La comparten las copias de la escena y se libera con
+	// la ultima.
+	Arena& getArena() { return *arena; }
+
+	// Tabla de materiales de la escena: devuelve el indice del material de tipo type
+	// (MaterialType) y parametros p, que solo se crea si no habia ya uno igual
+	int addMaterial(int type, const float* p) { return materials.add(type, p, *arena); }
+	Material* getMaterial(int i) const { return materials.get(i); }
+	const MaterialTable& getMaterials() const { return materials; }
+
+	void add(Object* h) {
+		if (!h->bounded()) {
+			unbounded.push_back(h);
+			return;
+		}
+		if (h->moving()) moving.push_back(int(ol.size()));
+		ol.push_back(h);
+		packed.push_back(packSphere(h));
+	}
+	// Grupo repetido que usan las instancias de la escena; build le construye su estructura.
+	// La escena pasa a ser duena del cluster.
+	void addCluster(Cluster* c);
+	bool hasInstances() const { return !clusters.empty(); }
 	void setSkyColor(Vec3 sky) { this->sky = sky; }
 	void setInfColor(Vec3 inf) { this->inf = inf; }
 
-	Vec3 getSceneColor(const Ray& r);
+	// Prepara la estructura de aceleracion una vez anadidos todos los objetos:
+	// "bvh" (SAH), "lbvh" (Morton, en paralelo), "bvh4"/"bvh8" (SAH de 4/8 hijos con SIMD),
+	// "grid" (rejilla uniforme), "simd" (todas las esferas a la vez), "auto" ("simd" con pocas
+	// esferas y "bvh" si no) o "none" (recorrido lineal de la lista).
+	// Con instancias hay dos niveles del mismo tipo: una estructura por cluster y la de la
+	// escena sobre las cajas de las instancias. Devuelve false si no se conoce.
+	bool build(const std::string& name);
+
+	// Coloca los objetos que se mueven donde estan en el fotograma frame y reajusta la
+	// estructura de aceleracion desde sus hojas; solo la reconstruye si no sabe reajustarse
+	// o si su calidad se ha degradado demasiado
+	void setFrame(int frame);
+	bool isAnimated() const { return !moving.empty(); }
+
+	// Color de un rayo cuyo primer choque ya se conoce (p. ej. de closestHitPacket)
+	Vec3 getSceneColor(const Ray& r, Object* firstHit, const CollisionData& cd, Sampler* sampler);
+
+	// Choque mas cercano usando la estructura de aceleracion, o recorriendo todos los objetos.
+	// Se busca solo por distancia; punto y normal se calculan una vez, para el choque final.
+	Object* closestHit(const Ray& r, float t_min, float t_max, CollisionData& cd);
+	Object* closestHitLinear(const Ray& r, float t_min, float t_max, CollisionData& cd);
+	// Primer choque de n rayos primarios recorridos juntos (n <= Accelerator::MAX_PACKET)
+	void closestHitPacket(const Ray* rays, int n, Object** hits, CollisionData* cd);
+	// closestHit contando en cache las lecturas de la estructura de aceleracion
+	Object* closestHitCounted(const Ray& r, CollisionData& cd, NodeCache& cache);
+
+	// Color del cielo en la direccion del rayo y rebotes como mucho
+	Vec3 getBackground(const Ray& r) const;
+	int getMaxDepth() const { return d; }
+
+	// Objetos con caja, los de la estructura de aceleracion, y objetos infinitos (planos)
+	const std::vector<Object*>& getObjects() const { return ol; }
+	const std::vector<Object*>& getUnbounded() const { return unbounded; }
+	Accelerator* getAccelerator() const { return accel; }
+	void setAccelerator(Accelerator* a) { accel = arena->own(a); }
 
 protected:
-	Vec3 getSceneColor(const Ray& r, int depth);
+	Vec3 getSceneColor(const Ray& r, int depth, Sampler* sampler);
+	Vec3 shade(const Ray& r, Object* hit, const CollisionData& cd, int depth, Sampler* sampler);
+	// Prueba los objetos infinitos despues de los demas; hit es el choque que ya se tenia y
+	// closest su distancia (o el t_max del rayo), que se actualiza si hay uno mas cercano
+	Object* hitUnbounded(const Ray& r, float t_min, float& closest, Object* hit);
 
 private:
 	std::vector<Object*> ol;
+	std::vector<PackedSphere> packed;	// paralelo a ol, para el recorrido lineal
+	std::vector<Object*> unbounded;
+	std::vector<int> moving;	// indices en ol de los objetos que se mueven
+	std::vector<Cluster*> clusters;
+	std::shared_ptr<Arena> arena;
+	MaterialTable materials;
+	Accelerator* accel;
 	Vec3 sky;
 	Vec3 inf;
 	int d;
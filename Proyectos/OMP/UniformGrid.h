@@ -0,0 +1,36 @@
+#pragma once
+
+#include <vector>
+
+#include "AABB.h"
+#include "Accelerator.h"
+#include "PackedSphere.h"
+
+// Rejilla uniforme recorrida con 3D-DDA (Amanatides y Woo, 1987). Pensada para campos de
+// esferas repartidas de forma regular como los de randomScene(): se construye en O(n) y cada
+// rayo solo visita las celdas que atraviesa. Los objetos mucho mayores que la mediana (el
+// suelo) no entran en la rejilla; se prueban siempre aparte.
+class UniformGrid : public Accelerator {
+public:
+	void build(const std::vector<Object*>& ol);
+	Object* intersect(const Ray& r, float t_min, float t_max, float& t) const;
+	Object* intersectCounted(const Ray& r, float t_min, float t_max, float& t, NodeCache& cache) const;
+
+private:
+	int cellIndex(int x, int y, int z) const { return (z * res[1] + y) * res[0] + x; }
+	void cellRange(const AABB& b, int lo[3], int hi[3]) const;
+
+	AABB bounds;
+	int res[3];
+	Vec3 cellSize;
+	Vec3 invCellSize;
+
+	// objetos de la celda c: objects[cellStart[c]] .. objects[cellStart[c + 1] - 1]
+	std::vector<int> cellStart;
+	std::vector<Object*> objects;
+	std::vector<PackedSphere> spheres;	// paralelo a objects
+	std::vector<Object*> large;
+
+	template <bool COUNT>
+	Object* traverse(const Ray& r, float t_min, float t_max, float& closest, NodeCache* cache) const;
+};
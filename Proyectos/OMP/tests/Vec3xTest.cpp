@@ -0,0 +1,137 @@
+// Prueba de Vec3xN: cada carril ha de dar exactamente (bit a bit) lo mismo que Vec3 y las
+// funciones escalares de utils.h, y los scatterLanes de los materiales lo mismo que su scatter.
+// Entradas aleatorias con semilla fija; devuelve 1 si algun carril no coincide.
+
+#include <cstring>
+#include <iostream>
+#include <random>
+
+#include "Vec3.h"
+#include "Vec3x.h"
+#include "utils.h"
+#include "Diffuse.h"
+#include "Metallic.h"
+#include "Crystalline.h"
+
+static const int GROUPS = 50000;
+
+// Devuelve siempre las uniformes que se le dan, en orden
+class FixedSampler : public Sampler {
+public:
+	FixedSampler(const float* u) : u(u), next(0) {}
+	void startPixelSample(int, int, int, int, int dimension = 0) { next = dimension; }
+	float get1D() { return u[next++]; }
+	void get2D(float& u1, float& u2) { u1 = u[next++]; u2 = u[next++]; }
+	int getDimension() const { return next; }
+
+private:
+	const float* u;
+	int next;
+};
+
+struct Check {
+	const char* name;
+	long long lanes = 0;
+	long long fails = 0;
+
+	void add(bool ok) {
+		lanes++;
+		if (!ok) fails++;
+	}
+};
+
+// Mismos bits (o NaN en los dos)
+static bool same(float a, float b) {
+	if (a != a && b != b) return true;
+	return std::memcmp(&a, &b, sizeof(float)) == 0;
+}
+static bool same(const Vec3& a, const Vec3& b) {
+	return same(a.x(), b.x()) && same(a.y(), b.y()) && same(a.z(), b.z());
+}
+
+template <int N>
+static void checkLanes(std::mt19937& gen, Check* c) {
+	std::uniform_real_distribution<float> coord(-2.0f, 2.0f), unit(0.0f, 1.0f), eta(0.4f, 2.5f);
+	auto randomVec = [&]() { return Vec3(coord(gen), coord(gen), coord(gen)); };
+
+	for (int g = 0; g < GROUPS; g++) {
+		Vec3 a[N], b[N], n[N], p[N];
+		float e[N], fuzz[N], ri[N], u[N][3];
+		Vec3xN<N> va, vb, vn, vp;
+		FloatxN<N> ve, vfuzz, vri;
+		for (int k = 0; k < N; k++) {
+			a[k] = randomVec();
+			b[k] = randomVec();
+			n[k] = unit_vector(randomVec());
+			p[k] = randomVec();
+			e[k] = eta(gen);
+			fuzz[k] = unit(gen);
+			ri[k] = 1.0f + eta(gen);
+			for (int d = 0; d < 3; d++) u[k][d] = unit(gen);
+			va.set(k, a[k]);
+			vb.set(k, b[k]);
+			vn.set(k, n[k]);
+			vp.set(k, p[k]);
+			ve[k] = e[k];
+			vfuzz[k] = fuzz[k];
+			vri[k] = ri[k];
+		}
+
+		FloatxN<N> d = dot(va, vb);
+		Vec3xN<N> x = cross(va, vb);
+		Vec3xN<N> uv = unit_vector(va);
+		Vec3xN<N> rl = reflect(va, vn);
+		Vec3xN<N> rr(Vec3(0, 0, 0));
+		int refracts = refract(va, vn, ve, rr);
+		Vec3xN<N> diffuse, metallic, crystalline;
+		Diffuse::scatterLanes(vp, vn, u, diffuse);
+		int bounces = Metallic::scatterLanes(va, vn, vfuzz, u, metallic);
+		Crystalline::scatterLanes(va, vn, vri, u, crystalline);
+
+		for (int k = 0; k < N; k++) {
+			c[0].add(same(d[k], dot(a[k], b[k])));
+			c[1].add(same(x.get(k), cross(a[k], b[k])));
+			c[2].add(same(uv.get(k), unit_vector(a[k])));
+			c[3].add(same(rl.get(k), reflect(a[k], n[k])));
+			Vec3 refracted(0, 0, 0);
+			bool ok = refract(a[k], n[k], e[k], refracted);
+			c[4].add(ok == bool((refracts >> k) & 1) && same(rr.get(k), refracted));
+
+			CollisionData cd;
+			cd.p = p[k];
+			cd.normal = n[k];
+			Ray in(p[k], a[k]), out;
+			Vec3 attenuation;
+			FixedSampler s0(u[k]), s1(u[k]), s2(u[k]);
+			Diffuse(Vec3(0.5f, 0.5f, 0.5f)).scatter(in, cd, attenuation, out, &s0);
+			c[5].add(same(diffuse.get(k), out.direction()));
+			ok = Metallic(Vec3(0.5f, 0.5f, 0.5f), fuzz[k]).scatter(in, cd, attenuation, out, &s1);
+			c[6].add(ok == bool((bounces >> k) & 1) && same(metallic.get(k), out.direction()));
+			Crystalline(ri[k]).scatter(in, cd, attenuation, out, &s2);
+			c[7].add(same(crystalline.get(k), out.direction()));
+		}
+	}
+}
+
+template <int N>
+static bool run(std::mt19937& gen) {
+	Check c[8];
+	const char* names[8] = { "dot", "cross", "unit_vector", "reflect", "refract", "Diffuse::scatter", "Metallic::scatter", "Crystalline::scatter" };
+	for (int i = 0; i < 8; i++) c[i].name = names[i];
+	checkLanes<N>(gen, c);
+
+	bool ok = true;
+	for (const Check& r : c) {
+		std::cout << "N = " << N << "  " << r.name << ": " << r.lanes << " carriles, " << r.fails << " distintos" << std::endl;
+		if (r.fails) ok = false;
+	}
+	return ok;
+}
+
+int main() {
+	std::mt19937 gen(42);
+	bool ok = run<4>(gen);
+	ok = run<8>(gen) && ok;
+	std::cout << (ok ? "OK" : "FALLO") << std::endl;
+	return ok ? 0 : 1;
+}
@@ -13,7 +13,7 @@ void writeBMP(const char* filename, unsigned char* data, int w, int h) {
 	int fs = hs + is;
 	const int offset = 40;
 
-	char header[hs];
+	char header[hs] = {}; // los campos reservados quedan a 0: ficheros identicos byte a byte
 	header[0] = 'B';
 	header[1] = 'M';
 	int* pi = (int*)(header + 2);
@@ -79,3 +79,7 @@ bool refract(const Vec3& v, const Vec3& n, float ni_over_nt, Vec3& refracted) {
 Vec3 reflect(const Vec3& v, const Vec3& n) {
 	return v - 2 * dot(v, n) * n;
 }
+
+float luminance(const Vec3& c) {
+	return 0.2126f * c.r() + 0.7152f * c.g() + 0.0722f * c.b();
+}